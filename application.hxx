@@ -1,31 +1,36 @@
 #pragma once
 
 #include "storage.hxx"
+#include "watcher.hxx"
+#include "buffers.hxx"
+#include "referenceIndex.hxx"
+#include "sourceFile.hxx"
 #include "libclang++/libclang++.hxx"
 #include "libclang++/translationUnitCache.hxx"
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 class Application {
 public:
-  Application (Storage & storage, unsigned int cacheLimit)
+  Application (Storage & storage, unsigned long cacheLimit, unsigned long residentLimit,
+               unsigned long astCacheLimit, unsigned int jobs, bool skipBodies)
     : storage_ (storage),
-      tu_ (cacheLimit)
-  {
-    const size_t size = 4096;
-    cwd_ = new char[size];
-    if (getcwd (cwd_, size) == NULL) {
-      // FIXME: correctly handle this case
-     throw std::runtime_error ("Not enough space to store current directory name.");
-    }
-  }
+      tu_ (cacheLimit, residentLimit),
+      ast_ (".ct.cache", astCacheLimit),
+      jobs_ (jobs),
+      skipBodies_ (skipBodies)
+  { }
 
   ~Application () {
-    delete[] cwd_;
+    // Stop background updates before anything else gets destroyed
+    watcher_.reset();
   }
 
 
   struct CompilationDatabaseArgs {
     std::string fileName;
+    bool        merge;      // keep stored commands which are not in the database
   };
   void compilationDatabase (CompilationDatabaseArgs & args, std::ostream & cout);
 
@@ -33,6 +38,9 @@ public:
   struct IndexArgs {
     std::vector<std::string> exclude;
     bool                     diagnostics;
+    int                      jobs;
+    bool                     deferIndexes;
+    std::string              engine;        // "visitor" or "callbacks"
   };
   void index (IndexArgs & args, std::ostream & cout);
   void update (IndexArgs & args, std::ostream & cout);
@@ -54,41 +62,152 @@ public:
   void grep (const GrepArgs & args, std::ostream & cout);
 
 
+  struct BufferArgs {
+    std::string fileName;
+    std::string contents;
+    int         offset1;
+    int         offset2;
+    std::string text;
+    bool        close;
+  };
+  void buffer (BufferArgs & args, std::ostream & cout);
+
+
   struct CompleteArgs {
     std::string fileName;
     int         line;
     int         column;
+    std::string prefix;
+    int         limit;
   };
   void complete (CompleteArgs & args, std::ostream & cout);
 
+  struct Candidate {
+    std::string  name;          // text to be typed
+    std::string  kind;
+    std::string  type;          // result type
+    std::string  signature;
+    unsigned int priority;      // lower is better
+  };
+
+
+  // Watch indexed files, and update the index in the background when they are
+  // modified (after `delay` milliseconds without modifications)
+  void watch (unsigned int delay);
+  void status (std::ostream & cout);
+
+  // Report memory usage of cached translation units
+  void stats (std::ostream & cout);
+
 
 private:
   void updateIndex_ (IndexArgs & args, std::ostream & cout);
   void findDefinitionFromIndex_  (FindDefinitionArgs & args, std::ostream & cout);
   void findDefinitionFromSource_ (FindDefinitionArgs & args, std::ostream & cout);
+  unsigned int backgroundUpdate_ (const std::set<std::string> & modified);
+  void watchFiles_ ();
+
+  // Read-only connection to the database, taken from a pool for the duration
+  // of a request. Such requests can run concurrently with the writer
+  // connection (storage_).
+  class Reader {
+  public:
+    Reader (Application & app)
+      : app_ (app)
+    {
+      {
+        std::lock_guard<std::mutex> lock (app_.readersMutex_);
+        if (!app_.readers_.empty()) {
+          storage_ = std::move (app_.readers_.back());
+          app_.readers_.pop_back();
+        }
+      }
+
+      if (storage_) {
+        // Interned strings stay cached as long as the writer commits nothing
+        storage_->refreshCaches();
+      } else {
+        storage_.reset (new Storage (Storage::Reader));
+      }
+    }
+
+    ~Reader () {
+      std::lock_guard<std::mutex> lock (app_.readersMutex_);
+      app_.readers_.push_back (std::move (storage_));
+    }
 
-  LibClang::TranslationUnit & translationUnit_ (std::string fileName) {
+    Storage * operator-> () {
+      return storage_.get();
+    }
+
+    Storage & operator* () {
+      return *storage_;
+    }
+
+  private:
+    Application & app_;
+    std::unique_ptr<Storage> storage_;
+  };
+
+  LibClang::TranslationUnit & translationUnit_ (std::string fileName,
+                                                LibClang::UnsavedFiles & unsaved) {
+    // Compile commands only hold absolute paths (see CompileCommand): parsing
+    // does not depend on the current working directory
     std::string directory;
     std::vector<std::string> clArgs;
-    storage_.getCompileCommand (fileName, directory, clArgs);
+    const int flags = Reader (*this)->getCompileCommand (fileName, directory, clArgs);
 
-    // chdir() to the correct directory
-    // (whether we need to parse the TU for the first time or reparse it)
-    chdir (directory.c_str());
+    if (tu_.contains (fileName) && tu_.flags (fileName) != flags) {
+      // The compilation command changed since the translation unit was parsed
+      tu_.remove (fileName);
+    }
 
     if (!tu_.contains (fileName)) {
-      LibClang::TranslationUnit tu = index_.parse (clArgs);
-      tu_.insert (fileName, tu);
+      // Translation units used for completion get reparsed when files change:
+      // parse them with a precompiled preamble
+      LibClang::TranslationUnit tu = index_.parse (clArgs, unsaved, LibClang::Index::Editing);
+      tu_.insert (fileName, tu, unsaved, flags);
       return tu_.get (fileName);
     } else {
-      LibClang::TranslationUnit & tu = tu_.get (fileName);
-      tu.reparse();
-      return tu;
+      // Only reparse if source files or buffers changed since the last request
+      tu_.reparse (fileName, unsaved);
+      return tu_.get (fileName);
     }
   }
 
   Storage & storage_;
   LibClang::Index index_;
   LibClang::TranslationUnitCache tu_;
-  char* cwd_;
+  LibClang::AstCache ast_;
+  Buffers buffers_;
+  ReferenceIndex references_;
+  SourceFiles sources_;
+
+  // Completion candidates for the last completion point, filtered as the user
+  // types a prefix
+  struct CompletionSession {
+    std::string             fileName;
+    int                     line;
+    int                     column;
+    unsigned long long      context;    // hash of the main file contents (except the prefix)
+    unsigned long long      others;     // hash of other unsaved buffers
+    LibClang::Dependencies  dependencies;
+    std::vector<Candidate>  candidates;
+  };
+  CompletionSession completion_;
+  unsigned int jobs_;
+  bool skipBodies_;
+
+  // Requests modifying the database (including background updates) are
+  // serialized
+  std::mutex writeMutex_;
+
+  // Requests using libclang translation units (tu_, ast_, index_, completion_)
+  // are serialized
+  std::mutex parseMutex_;
+
+  std::mutex readersMutex_;
+  std::vector<std::unique_ptr<Storage>> readers_;
+
+  std::unique_ptr<Watcher> watcher_;
 };
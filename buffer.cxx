@@ -0,0 +1,28 @@
+#include "application.hxx"
+#include "json/json.h"
+
+void Application::buffer (BufferArgs & args, std::ostream & cout) {
+  if (args.close) {
+    buffers_.remove (args.fileName);
+    return;
+  }
+
+  long size;
+  if (args.offset1 < 0) {
+    buffers_.set (args.fileName, args.contents);
+    size = args.contents.size();
+  } else {
+    size = buffers_.edit (args.fileName, args.offset1, args.offset2, args.text);
+    if (size < 0) {
+      // The editor should send the whole buffer again
+      cout << "Could not edit buffer `" << args.fileName << "'" << std::endl;
+      return;
+    }
+  }
+
+  Json::FastWriter writer;
+  Json::Value json;
+  json["file"] = args.fileName;
+  json["size"] = (Json::Int64)size;
+  cout << writer.write (json);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "libclang++/unsavedFiles.hxx"
+#include "compileCommand.hxx"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Registry of unsaved editor buffers
+//
+// Editors push the contents of a modified buffer once, and then only send
+// edits. Requests using libclang get the current contents of all buffers as
+// unsaved files, so that no temporary file is needed.
+//
+// Buffers are keyed by canonical path, like translation units and indexed
+// files, so that editors can name them in any way.
+class Buffers {
+public:
+  // Set the whole contents of a buffer
+  void set (const std::string & fileName, const std::string & contents) {
+    const std::string key = key_ (fileName);
+    std::lock_guard<std::mutex> lock (mutex_);
+    buffers_[key].reset (new std::string (contents));
+  }
+
+  // Replace the range [offset1, offset2) of a buffer (counted in bytes) with
+  // `text`. Return the new buffer size, or -1 if the edit can't be applied.
+  long edit (const std::string & fileName,
+             unsigned long offset1, unsigned long offset2,
+             const std::string & text) {
+    const std::string key = key_ (fileName);
+    std::lock_guard<std::mutex> lock (mutex_);
+    auto it = buffers_.find (key);
+    if (it == buffers_.end()
+        || offset1 > offset2 || offset2 > it->second->size()) {
+      return -1;
+    }
+
+    // Contents may still be in use by a request: copy them before editing
+    std::shared_ptr<std::string> & contents = it->second;
+    if (contents.use_count() > 1) {
+      contents.reset (new std::string (*contents));
+    }
+    contents->replace (offset1, offset2 - offset1, text);
+    return contents->size();
+  }
+
+  // Forget a buffer (e.g. once it is saved or closed)
+  void remove (const std::string & fileName) {
+    const std::string key = key_ (fileName);
+    std::lock_guard<std::mutex> lock (mutex_);
+    buffers_.erase (key);
+  }
+
+  // Current contents of a buffer (or NULL if the file is not modified)
+  std::shared_ptr<const std::string> contents (const std::string & fileName) const {
+    const std::string key = key_ (fileName);
+    std::lock_guard<std::mutex> lock (mutex_);
+    auto it = buffers_.find (key);
+    if (it == buffers_.end()) {
+      return std::shared_ptr<const std::string> ();
+    }
+    return it->second;
+  }
+
+  // Current contents of all buffers (except `exclude`), to be passed to libclang
+  LibClang::UnsavedFiles unsavedFiles (const std::string & exclude = "") const {
+    const std::string excludeKey = exclude.empty() ? exclude : key_ (exclude);
+    std::lock_guard<std::mutex> lock (mutex_);
+    LibClang::UnsavedFiles unsaved;
+    for (const auto & buffer : buffers_) {
+      if (buffer.first == excludeKey) {
+        continue;
+      }
+      unsaved.add (buffer.first, std::shared_ptr<const std::string> (buffer.second));
+    }
+    return unsaved;
+  }
+
+private:
+  static std::string key_ (const std::string & fileName) {
+    return CompileCommand::fileName ("", fileName);
+  }
+
+  mutable std::mutex                                  mutex_;
+  std::map<std::string, std::shared_ptr<std::string>> buffers_;
+};
@@ -0,0 +1,135 @@
+#include "getopt++/getopt.hxx"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+// Minimal client for the clang-tags server
+//
+// Standard input is forwarded to the server socket, and everything the server
+// sends back is copied to standard output. Depending on what is written on
+// standard input, this can be used either for one-shot requests (a JSON
+// request followed by a blank line), or to keep a persistent connection open
+// and send newline-delimited requests with an "id" (see server.hxx).
+
+namespace {
+  // Write a whole buffer; return false on error
+  bool writeAll (int fd, const char * data, size_t size) {
+    while (size > 0) {
+      const ssize_t n = (fd == STDOUT_FILENO)
+        ? write (fd, data, size)
+        : send (fd, data, size, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  int connect_ (const std::string & socketPath) {
+    sockaddr_un address;
+    if (socketPath.size() >= sizeof (address.sun_path)) {
+      std::cerr << "Socket path too long: " << socketPath << std::endl;
+      return -1;
+    }
+
+    const int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      std::cerr << "Could not create socket: " << strerror (errno) << std::endl;
+      return -1;
+    }
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strcpy (address.sun_path, socketPath.c_str());
+    if (connect (fd, (sockaddr*)&address, sizeof (address)) == -1) {
+      std::cerr << "Could not connect to `" << socketPath << "': "
+                << strerror (errno) << std::endl;
+      close (fd);
+      return -1;
+    }
+    return fd;
+  }
+}
+
+int main (int argc, char **argv) {
+  Getopt options (argc, argv);
+  options.add ("help", 'h', 0,
+               "print this help message and exit");
+  options.add ("socket", 's', 1,
+               "specify the path to the server socket (default: .ct.sock)");
+
+  try {
+    options.get();
+  } catch (...) {
+    std::cerr << options.usage();
+    return 1;
+  }
+
+  if (options.getCount ("help") > 0) {
+    std::cerr << options.usage();
+    return 0;
+  }
+
+  std::string socketPath = ".ct.sock";
+  if (options.getCount ("socket") > 0) {
+    socketPath = options["socket"];
+  }
+
+  const int server = connect_ (socketPath);
+  if (server == -1) {
+    return EXIT_FAILURE;
+  }
+
+  // Relay data in both directions, until the server closes the connection
+  pollfd fds[2];
+  fds[0].fd     = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  fds[1].fd     = server;
+  fds[1].events = POLLIN;
+
+  char buffer[65536];
+  while (true) {
+    if (poll (fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "poll: " << strerror (errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+      const ssize_t n = read (server, buffer, sizeof (buffer));
+      if (n <= 0) {
+        break;
+      }
+      if (!writeAll (STDOUT_FILENO, buffer, n)) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      const ssize_t n = read (STDIN_FILENO, buffer, sizeof (buffer));
+      if (n <= 0) {
+        // No more requests: let the server finish answering
+        shutdown (server, SHUT_WR);
+        fds[0].fd = -1;
+      } else if (!writeAll (server, buffer, n)) {
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  close (server);
+  return EXIT_SUCCESS;
+}
@@ -9,8 +9,24 @@ find_library (Libclang_LIBRARY clang
 set (Libclang_LIBRARIES    ${Libclang_LIBRARY})
 set (Libclang_INCLUDE_DIRS ${Libclang_INCLUDE_DIR})
 
+# libclang >= 3.5 is needed for the CXErrorCode API
+# (clang_parseTranslationUnit2 and clang_createTranslationUnit2)
+if (Libclang_LIBRARY AND Libclang_INCLUDE_DIR)
+  include (CheckSymbolExists)
+  set (CMAKE_REQUIRED_INCLUDES  ${Libclang_INCLUDE_DIR})
+  set (CMAKE_REQUIRED_LIBRARIES ${Libclang_LIBRARY})
+  check_symbol_exists (clang_parseTranslationUnit2  "clang-c/Index.h"
+    Libclang_HAVE_PARSETRANSLATIONUNIT2)
+  check_symbol_exists (clang_createTranslationUnit2 "clang-c/Index.h"
+    Libclang_HAVE_CREATETRANSLATIONUNIT2)
+  unset (CMAKE_REQUIRED_INCLUDES)
+  unset (CMAKE_REQUIRED_LIBRARIES)
+endif (Libclang_LIBRARY AND Libclang_INCLUDE_DIR)
+
 include (FindPackageHandleStandardArgs)
-find_package_handle_standard_args (Libclang  DEFAULT_MSG
-  Libclang_LIBRARY Libclang_INCLUDE_DIR)
+find_package_handle_standard_args (Libclang
+  "Could NOT find libclang >= 3.5"
+  Libclang_LIBRARY Libclang_INCLUDE_DIR
+  Libclang_HAVE_PARSETRANSLATIONUNIT2 Libclang_HAVE_CREATETRANSLATIONUNIT2)
 
 mark_as_advanced (Libclang_INCLUDE_DIR Libclang_LIBRARY)
\ No newline at end of file
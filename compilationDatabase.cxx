@@ -1,39 +1,107 @@
 #include "application.hxx"
-#include "json/json.h"
+#include "compileCommand.hxx"
 #include <fstream>
 
 void Application::compilationDatabase (CompilationDatabaseArgs & args,
                                        std::ostream & cout) {
-  // Change back to the original WD (in case `index` or `update` would have
-  // changed it)
-  chdir (cwd_);
-
-  Json::Value root;
-  Json::Reader reader;
+  std::lock_guard<std::mutex> lock (writeMutex_);
 
+  // Relative paths are given w.r.t the server's working directory, which
+  // never changes
   std::ifstream json (args.fileName);
-  bool ret = reader.parse (json, root);
-  if ( !ret ) {
-    cout  << "Failed to parse compilation database `" << args.fileName << "'\n"
-          << reader.getFormattedErrorMessages();
+  if (!json) {
+    cout << "Could not open compilation database `" << args.fileName << "'" << std::endl;
+    return;
+  }
+
+  // Compare the database to the stored commands, entry by entry, and only
+  // keep track of the differences. Flag sets are compared by id.
+  struct Command {
+    std::string           directory;
+    CompileCommand::Flags flags;
+  };
+  std::map<std::string, Storage::Command> stored = storage_.compileCommands();
+  std::map<std::string, Command> changed;
+  std::set<std::string> seen;
+
+  CompileCommand::Reader reader (json);
+  CompileCommand::Entry entry;
+  try {
+    while (reader.next (entry)) {
+      const std::string fileName = CompileCommand::fileName (entry.directory, entry.file);
+      Command command;
+      command.directory = entry.directory;
+      command.flags = CompileCommand::flags (CompileCommand::normalize (entry.directory, entry.args),
+                                             CompileCommand::absolute (entry.directory, entry.file));
+
+      Storage::Command storedCommand;
+      storedCommand.directory = command.directory;
+      storedCommand.flags     = storage_.findFlags (command.flags.args);
+      storedCommand.position  = command.flags.position;
+
+      // Later entries for the same file take precedence
+      seen.insert (fileName);
+      auto it = stored.find (fileName);
+      if (it != stored.end() && it->second == storedCommand) {
+        changed.erase (fileName);
+      } else {
+        changed[fileName] = command;
+      }
+    }
+  } catch (std::runtime_error & e) {
+    cout << "Failed to parse compilation database `" << args.fileName << "'\n"
+         << "  " << e.what() << std::endl;
+    return;
   }
 
-  auto transaction(storage_.beginTransaction());
+  std::vector<std::string> removed;
+  if (!args.merge) {
+    for (const auto & it : stored) {
+      if (seen.count (it.first) == 0) {
+        removed.push_back (it.first);
+      }
+    }
+  }
 
-  for (unsigned int i=0 ; i<root.size() ; ++i) {
-    std::string fileName = root[i]["file"].asString();
-    std::string directory = root[i]["directory"].asString();
+  // Write all differences at once
+  unsigned int added = 0;
+  {
+    auto transaction (storage_.beginTransaction());
+    for (const auto & it : changed) {
+      const bool isNew = (stored.count (it.first) == 0);
+      added += isNew;
+      cout << (isNew ? "  added:   " : "  changed: ") << it.first << std::endl;
+      storage_.setCompileCommand (it.first, it.second.directory, it.second.flags);
+    }
+    for (const auto & fileName : removed) {
+      cout << "  removed: " << fileName << std::endl;
+      storage_.removeFile (fileName);
+    }
+    if (!removed.empty()) {
+      // Files which were only included by removed translation units
+      storage_.removeUnincludedFiles();
+    }
+    storage_.removeUnusedFlags();
+  }
 
-    std::vector<std::string> clArgs;
-    std::istringstream command (root[i]["command"].asString());
-    std::string arg;
-    std::getline (command, arg, ' ');
-    do {
-      std::getline (command, arg, ' ');
-      clArgs.push_back (arg);
-    } while (! command.eof());
+  // Forget cached references to the removed files
+  references_.invalidate (storage_.modifiedFiles());
 
-    cout << "  " << fileName << std::endl;
-    storage_.setCompileCommand (fileName, directory, clArgs);
+  // Cached translation units were parsed with outdated commands
+  {
+    std::lock_guard<std::mutex> lock (parseMutex_);
+    for (const auto & it : changed) {
+      tu_.remove (it.first);
+    }
+    for (const auto & fileName : removed) {
+      tu_.remove (fileName);
+    }
   }
+
+  cout << reader.count() << " entries: "
+       << added << " added, "
+       << changed.size() - added << " changed, "
+       << removed.size() << " removed" << std::endl;
+
+  watchFiles_ ();
 }
@@ -0,0 +1,532 @@
+#pragma once
+
+#include <stdlib.h>
+#include <cctype>
+#include <cstring>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compilation commands, as stored in the database
+//
+// Commands are made independent of the current working directory when they
+// are loaded: all file arguments are made absolute, relative to the directory
+// in which the compiler was run. Translation units can thus be parsed without
+// ever changing the working directory, which would affect all threads of the
+// server (and the relative paths of the database and socket).
+//
+// "-working-directory" options are removed: recent libclang versions
+// implement them by calling chdir() in the driver.
+namespace CompileCommand {
+  // Make a path absolute, relative to `directory`
+  inline std::string absolute (const std::string & directory, const std::string & path) {
+    if (path.empty() || path[0] == '/' || directory.empty()) {
+      return path;
+    }
+    if (path == ".") {
+      return directory;
+    }
+    if (path.compare (0, 2, "./") == 0) {
+      return absolute (directory, path.substr (2));
+    }
+    if (directory[directory.size()-1] == '/') {
+      return directory + path;
+    }
+    return directory + "/" + path;
+  }
+
+  // Canonical absolute path of a source file, relative to `directory`
+  inline std::string fileName (const std::string & directory, const std::string & file) {
+    const std::string path = absolute (directory, file);
+    char * canonicalPath = realpath (path.c_str(), NULL);
+    if (!canonicalPath) {
+      return path;
+    }
+    std::string res (canonicalPath);
+    free (canonicalPath);
+    return res;
+  }
+
+  namespace Detail {
+    // Options followed by a separate path argument
+    inline bool takesPath (const std::string & arg) {
+      static const char * const options[] = {
+        "-I", "-F", "-L", "-B", "-o", "-MF",
+        "-isystem", "-iquote", "-idirafter", "-isysroot", "--sysroot",
+        "-include", "-include-pch", "-imacros", "-iprefix",
+        "-iwithprefixbefore", "-iwithprefix",
+        NULL };
+      for (const char * const * option = options ; *option ; ++option) {
+        if (arg == *option) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Options followed by a separate argument which is not a path
+    inline bool takesValue (const std::string & arg) {
+      static const char * const options[] = {
+        "-x", "-D", "-U", "-MT", "-MQ", "-arch", "-target",
+        "-Xclang", "-Xpreprocessor", "-Xassembler", "-Xlinker", "-mllvm",
+        "--param", "-z", "-u", "-e",
+        NULL };
+      for (const char * const * option = options ; *option ; ++option) {
+        if (arg == *option) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Options with a path joined to them (such as "-Ifoo" or
+    // "--sysroot=foo"); returns the length of the option name, or 0
+    inline size_t joinedPath (const std::string & arg) {
+      static const char * const options[] = {
+        "--sysroot=", "-isystem", "-iquote", "-idirafter", "-isysroot",
+        "-I", "-F", "-L", "-B", "-o",
+        NULL };
+      for (const char * const * option = options ; *option ; ++option) {
+        const size_t size = std::strlen (*option);
+        if (arg.size() > size && arg.compare (0, size, *option) == 0) {
+          return size;
+        }
+      }
+      return 0;
+    }
+  }
+
+  // Make all file arguments of a command absolute, and remove
+  // "-working-directory" options
+  inline std::vector<std::string> normalize (std::string directory,
+                                             const std::vector<std::string> & args) {
+    // An explicit working directory takes precedence
+    for (size_t i = 0 ; i+1 < args.size() ; ++i) {
+      if (args[i] == "-working-directory") {
+        directory = absolute (directory, args[i+1]);
+      }
+    }
+
+    std::vector<std::string> res;
+    res.reserve (args.size());
+
+    for (size_t i = 0 ; i < args.size() ; ++i) {
+      const std::string & arg = args[i];
+
+      if (arg.empty()) {
+        continue;
+      } else if (arg == "-working-directory") {
+        ++i;
+      } else if (Detail::takesPath (arg) && i+1 < args.size()) {
+        res.push_back (arg);
+        res.push_back (absolute (directory, args[++i]));
+      } else if (arg == "-Xclang" && i+3 < args.size()
+                 && Detail::takesPath (args[i+1]) && args[i+2] == "-Xclang") {
+        // Frontend options taking a path, such as
+        //   -Xclang -include-pch -Xclang pch/foo.pch
+        res.push_back (arg);
+        res.push_back (args[++i]);
+        res.push_back (args[++i]);
+        res.push_back (absolute (directory, args[++i]));
+      } else if (Detail::takesValue (arg) && i+1 < args.size()) {
+        res.push_back (arg);
+        res.push_back (args[++i]);
+      } else if (arg[0] != '-') {
+        res.push_back (absolute (directory, arg));
+      } else if (size_t size = Detail::joinedPath (arg)) {
+        res.push_back (arg.substr (0, size) + absolute (directory, arg.substr (size)));
+      } else {
+        res.push_back (arg);
+      }
+    }
+    return res;
+  }
+
+  // Compiler flags of a command
+  //
+  // These are the arguments of the command, without the source file itself
+  // nor the names of per-file outputs, which don't affect parsing. Most
+  // translation units of a project share the same flags.
+  struct Flags {
+    std::vector<std::string> args;
+    int                      position;    // position of the source file in the command (-1 if unknown)
+
+    // Command compiling `fileName` with these flags
+    std::vector<std::string> command (const std::string & fileName) const {
+      std::vector<std::string> res (args);
+      if (position >= 0 && position <= (int)res.size()) {
+        res.insert (res.begin() + position, fileName);
+      }
+      return res;
+    }
+  };
+
+  // Extract the flags of a normalized command compiling `source`
+  inline Flags flags (const std::vector<std::string> & args, const std::string & source) {
+    Flags res;
+    res.position = -1;
+
+    for (size_t i = 0 ; i < args.size() ; ++i) {
+      const std::string & arg = args[i];
+
+      if ((arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-MQ")
+          && i+1 < args.size()) {
+        ++i;
+      } else if ((Detail::takesPath (arg) || Detail::takesValue (arg))
+                 && i+1 < args.size()) {
+        res.args.push_back (arg);
+        res.args.push_back (args[++i]);
+      } else if (res.position == -1 && !arg.empty() && arg[0] != '-'
+                 && (arg == source || fileName ("", arg) == fileName ("", source))) {
+        res.position = res.args.size();
+      } else {
+        res.args.push_back (arg);
+      }
+    }
+    return res;
+  }
+
+
+  // Split a shell command line into arguments
+  //
+  // Arguments are separated by unquoted blanks; single quotes, double quotes
+  // and backslashes are interpreted as a POSIX shell would (without any
+  // expansion). Unterminated quotes raise a std::runtime_error.
+  inline std::vector<std::string> split (const std::string & command) {
+    std::vector<std::string> res;
+    std::string arg;
+    bool inArg = false;   // an argument has been started (possibly empty: "")
+
+    for (size_t i = 0 ; i < command.size() ; ++i) {
+      const char c = command[i];
+      switch (c) {
+      case ' ': case '\t': case '\n': case '\r':
+        if (inArg) {
+          res.push_back (arg);
+          arg.clear();
+          inArg = false;
+        }
+        break;
+
+      case '\'':
+        inArg = true;
+        for (++i ; i < command.size() && command[i] != '\'' ; ++i) {
+          arg += command[i];
+        }
+        if (i == command.size()) {
+          throw std::runtime_error ("unterminated single quote in command");
+        }
+        break;
+
+      case '"':
+        inArg = true;
+        for (++i ; i < command.size() && command[i] != '"' ; ++i) {
+          // Inside double quotes, backslashes only escape a few characters
+          if (command[i] == '\\' && i+1 < command.size()
+              && std::strchr ("\"\\$`\n", command[i+1])) {
+            ++i;
+          }
+          arg += command[i];
+        }
+        if (i == command.size()) {
+          throw std::runtime_error ("unterminated double quote in command");
+        }
+        break;
+
+      case '\\':
+        inArg = true;
+        if (i+1 < command.size()) {
+          arg += command[++i];
+        }
+        break;
+
+      default:
+        inArg = true;
+        arg += c;
+      }
+    }
+
+    if (inArg) {
+      res.push_back (arg);
+    }
+    return res;
+  }
+
+
+  // Entry of a JSON compilation database
+  struct Entry {
+    std::string              directory;
+    std::string              file;
+    std::vector<std::string> args;    // compiler arguments, without the compiler itself
+  };
+
+  // Streaming reader for JSON compilation databases
+  //
+  // Entries are parsed one at a time, so that large databases never have to
+  // be held in memory as a whole. Both the "command" and the "arguments"
+  // forms are understood (the latter taking precedence); other members are
+  // ignored. Syntax errors raise a std::runtime_error.
+  //
+  //   CompileCommand::Reader reader (std::cin);
+  //   CompileCommand::Entry entry;
+  //   while (reader.next (entry)) {
+  //     ...
+  //   }
+  class Reader {
+  public:
+    Reader (std::istream & input)
+      : input_ (*input.rdbuf()),
+        line_  (1),
+        count_ (0),
+        done_  (false)
+    { }
+
+    // Read the next entry; return false at the end of the database
+    bool next (Entry & entry) {
+      if (done_) {
+        return false;
+      }
+
+      skipSpace_();
+      expect_ (count_ == 0 ? '[' : ',');
+      skipSpace_();
+      if (peek_() == ']' && count_ == 0) {
+        get_();
+        done_ = true;
+        return false;
+      }
+
+      entry = Entry();
+      bool hasArguments = false;
+      bool hasCommand   = false;
+      std::string command;
+
+      expect_ ('{');
+      skipSpace_();
+      if (peek_() == '}') {
+        error_ ("empty entry");
+      }
+      while (true) {
+        skipSpace_();
+        const std::string key = string_();
+        skipSpace_();
+        expect_ (':');
+        skipSpace_();
+
+        if (key == "directory") {
+          entry.directory = string_();
+        } else if (key == "file") {
+          entry.file = string_();
+        } else if (key == "command") {
+          command = string_();
+          hasCommand = true;
+        } else if (key == "arguments") {
+          entry.args.clear();
+          expect_ ('[');
+          skipSpace_();
+          while (peek_() != ']') {
+            entry.args.push_back (string_());
+            skipSpace_();
+            if (peek_() == ',') {
+              get_();
+              skipSpace_();
+            }
+          }
+          get_();
+          hasArguments = true;
+        } else {
+          skipValue_();
+        }
+
+        skipSpace_();
+        if (peek_() != ',') {
+          break;
+        }
+        get_();
+      }
+      expect_ ('}');
+      ++count_;
+
+      if (entry.file.empty()) {
+        error_ ("missing `file' in entry");
+      }
+      if (!hasArguments) {
+        if (!hasCommand) {
+          error_ ("missing `command' or `arguments' in entry");
+        }
+        try {
+          entry.args = split (command);
+        } catch (std::runtime_error & e) {
+          error_ (e.what());
+        }
+      }
+
+      // Drop the compiler
+      if (!entry.args.empty()) {
+        entry.args.erase (entry.args.begin());
+      }
+
+      skipSpace_();
+      if (peek_() == ']') {
+        get_();
+        done_ = true;
+      }
+      return true;
+    }
+
+    // Number of entries read so far
+    unsigned int count () const {
+      return count_;
+    }
+
+  private:
+    int peek_ () {
+      return input_.sgetc();
+    }
+
+    int get_ () {
+      const int c = input_.sbumpc();
+      if (c == std::char_traits<char>::eof()) {
+        error_ ("unexpected end of file");
+      }
+      if (c == '\n') {
+        ++line_;
+      }
+      return c;
+    }
+
+    void expect_ (char expected) {
+      if (peek_() != expected) {
+        error_ (std::string ("expected `") + expected + "'");
+      }
+      get_();
+    }
+
+    void skipSpace_ () {
+      int c = peek_();
+      while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        get_();
+        c = peek_();
+      }
+    }
+
+    std::string string_ () {
+      expect_ ('"');
+      std::string res;
+      while (true) {
+        const int c = get_();
+        if (c == '"') {
+          return res;
+        }
+        if (c != '\\') {
+          res += (char)c;
+          continue;
+        }
+
+        const int escaped = get_();
+        switch (escaped) {
+        case 'b': res += '\b'; break;
+        case 'f': res += '\f'; break;
+        case 'n': res += '\n'; break;
+        case 'r': res += '\r'; break;
+        case 't': res += '\t'; break;
+        case 'u': {
+          unsigned long codePoint = hex_();
+          if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+            // Surrogate pair
+            expect_ ('\\');
+            expect_ ('u');
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (hex_() - 0xDC00);
+          }
+          utf8_ (codePoint, res);
+          break;
+        }
+        default:
+          res += (char)escaped;
+        }
+      }
+    }
+
+    unsigned long hex_ () {
+      unsigned long res = 0;
+      for (int i = 0 ; i < 4 ; ++i) {
+        const int c = get_();
+        res *= 16;
+        if (c >= '0' && c <= '9')      res += c - '0';
+        else if (c >= 'a' && c <= 'f') res += c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') res += c - 'A' + 10;
+        else error_ ("invalid unicode escape");
+      }
+      return res;
+    }
+
+    static void utf8_ (unsigned long codePoint, std::string & res) {
+      if (codePoint < 0x80) {
+        res += (char)codePoint;
+      } else if (codePoint < 0x800) {
+        res += (char)(0xC0 | (codePoint >> 6));
+        res += (char)(0x80 | (codePoint & 0x3F));
+      } else if (codePoint < 0x10000) {
+        res += (char)(0xE0 | (codePoint >> 12));
+        res += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        res += (char)(0x80 | (codePoint & 0x3F));
+      } else {
+        res += (char)(0xF0 | (codePoint >> 18));
+        res += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        res += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        res += (char)(0x80 | (codePoint & 0x3F));
+      }
+    }
+
+    // Skip a value of any type
+    void skipValue_ () {
+      switch (peek_()) {
+      case '"':
+        string_();
+        break;
+      case '[':
+      case '{': {
+        const char close = (get_() == '[') ? ']' : '}';
+        skipSpace_();
+        while (peek_() != close) {
+          if (close == '}') {
+            string_();
+            skipSpace_();
+            expect_ (':');
+            skipSpace_();
+          }
+          skipValue_();
+          skipSpace_();
+          if (peek_() == ',') {
+            get_();
+            skipSpace_();
+          }
+        }
+        get_();
+        break;
+      }
+      default: // Numbers and literals
+        if (!std::isalnum (peek_()) && peek_() != '-') {
+          error_ ("unexpected character");
+        }
+        while (std::isalnum (peek_())
+               || peek_() == '+' || peek_() == '-' || peek_() == '.') {
+          get_();
+        }
+      }
+    }
+
+    void error_ (const std::string & message) {
+      std::ostringstream msg;
+      msg << "line " << line_ << ": " << message;
+      throw std::runtime_error (msg.str());
+    }
+
+    std::streambuf & input_;
+    unsigned int     line_;
+    unsigned int     count_;
+    bool             done_;
+  };
+}
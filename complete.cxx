@@ -1,7 +1,13 @@
 #include "application.hxx"
+#include "json/json.h"
 
 #include <clang-c/Index.h>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 
 
 namespace LibClang {
@@ -178,57 +184,189 @@ void printCompletionString(LibClang::Completion completion, std::ostream & strea
   }
 }
 
-void printCompletionResult(LibClang::CompletionResult completionResult,
-                             std::ostream & stream) {
+Application::Candidate candidate (LibClang::CompletionResult completionResult) {
   LibClang::Completion completion = completionResult.get();
 
-  stream << "COMPLETION";
-
-  // switch (completion.availability()){
-  // case CXAvailability_Available:
-  //   break;
-  // case CXAvailability_Deprecated:
-  //   stream << "(deprecated)";
-  //   break;
-  // case CXAvailability_NotAvailable:
-  //   stream << "(unavailable)";
-  //   break;
-  // case CXAvailability_NotAccessible:
-  //   stream << "(inaccessible)";
-  //   break;
-  // }
-  // stream << "(" << completion.priority() << ")";
-
-  stream << ": ";
+  Application::Candidate res;
+  res.kind     = completionResult.kindStr();
+  res.priority = completion.priority();
 
   int n = completion.size();
   for (int i = 0 ; i < n ; ++i) {
     LibClang::Chunk chunk = completion.chunk(i);
-    if (chunk.kind() == CXCompletionChunk_TypedText) {
-      stream << chunk.text() << " : ";
-      break;
+    if (chunk.kind() == CXCompletionChunk_TypedText && res.name.empty()) {
+      res.name = chunk.text();
+    }
+    if (chunk.kind() == CXCompletionChunk_ResultType) {
+      res.type = chunk.text();
     }
   }
 
-  printCompletionString(completion, stream);
+  std::ostringstream signature;
+  printCompletionString(completion, signature);
+  res.signature = signature.str();
 
-  stream << std::endl;
+  return res;
 }
 
-void Application::complete (CompleteArgs & args, std::ostream & cout) {
-  LibClang::TranslationUnit & tu = translationUnit_ (args.fileName);
+namespace {
+  // Offset of a position (line and column counted from 1, as in libclang) in
+  // a text, or std::string::npos if it is past the end
+  size_t offset (const std::string & text, int line, int column) {
+    size_t pos = 0;
+    for (int i = 1 ; i < line ; ++i) {
+      pos = text.find ('\n', pos);
+      if (pos == std::string::npos) {
+        return pos;
+      }
+      ++pos;
+    }
+    pos += column - 1;
+    return pos <= text.size() ? pos : std::string::npos;
+  }
+
+  // Hash of the source text around the completion point, leaving out the
+  // typed prefix (if it is present in the text)
+  unsigned long long contextHash (const std::string & text, size_t point,
+                                  const std::string & prefix) {
+    if (point == std::string::npos) {
+      point = text.size();
+    }
+    size_t resume = point;
+    if (text.compare (point, prefix.size(), prefix) == 0) {
+      resume = point + prefix.size();
+    }
+
+    // FNV-1a of both parts, separated by a null character
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0 ; i < point ; ++i) {
+      hash ^= (unsigned char)text[i];
+      hash *= 1099511628211ULL;
+    }
+    hash *= 1099511628211ULL;
+    for (size_t i = resume ; i < text.size() ; ++i) {
+      hash ^= (unsigned char)text[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  // Rank a candidate name against the typed prefix, lower being better:
+  // - 0: case-sensitive prefix match
+  // - 1: case-insensitive prefix match
+  // - 2 + number of skipped characters: fuzzy (subsequence) match
+  // Return -1 if the name does not match.
+  long rank (const std::string & name, const std::string & prefix) {
+    if (name.compare (0, prefix.size(), prefix) == 0) {
+      return 0;
+    }
+
+    bool isPrefix = true;
+    long skipped = 0;
+    size_t j = 0;
+    for (size_t i = 0 ; i < name.size() && j < prefix.size() ; ++i) {
+      if (std::tolower (name[i]) == std::tolower (prefix[j])) {
+        ++j;
+      } else {
+        isPrefix = false;
+        ++skipped;
+      }
+    }
+
+    if (j < prefix.size()) {
+      return -1;
+    }
+    return isPrefix ? 1 : 2 + skipped;
+  }
+}
 
-  CXCodeCompleteResults * results
-    = clang_codeCompleteAt(tu.raw(),
-                           args.fileName.c_str(), args.line, args.column,
-                           0, 0,
-                           clang_defaultCodeCompleteOptions());
-  LibClang::CodeCompletions completions (results);
-  completions.sort();
+void Application::complete (CompleteArgs & args, std::ostream & cout) {
+  std::lock_guard<std::mutex> lock (parseMutex_);
+
+  // Source text, which contains the typed prefix if the editor keeps the
+  // server informed of its buffer contents
+  std::string text;
+  {
+    auto buffer = buffers_.contents (args.fileName);
+    if (buffer) {
+      text = *buffer;
+    } else {
+      std::ifstream file (args.fileName, std::ios::binary);
+      text.assign (std::istreambuf_iterator<char> (file),
+                   std::istreambuf_iterator<char> ());
+    }
+  }
+  const unsigned long long context
+    = contextHash (text, offset (text, args.line, args.column), args.prefix);
+
+  // clang_codeCompleteAt reparses the main file with its unsaved contents
+  // (reusing the precompiled preamble): the translation unit itself only
+  // needs to be reparsed when other files change.
+  LibClang::UnsavedFiles others = buffers_.unsavedFiles (args.fileName);
+
+  // Completion results are computed once per completion point, and then
+  // filtered as long as nothing but the typed prefix changes
+  CompletionSession & session = completion_;
+  if (session.fileName != args.fileName
+      || session.line != args.line || session.column != args.column
+      || session.context != context || session.others != others.hash()
+      || !session.dependencies.upToDate()) {
+    LibClang::TranslationUnit & tu = translationUnit_ (args.fileName, others);
+
+    LibClang::UnsavedFiles unsaved = buffers_.unsavedFiles();
+    CXCodeCompleteResults * results
+      = clang_codeCompleteAt(tu.raw(),
+                             args.fileName.c_str(), args.line, args.column,
+                             unsaved.begin(), unsaved.size(),
+                             clang_defaultCodeCompleteOptions());
+    LibClang::CodeCompletions completions (results);
+
+    session.fileName     = args.fileName;
+    session.line         = args.line;
+    session.column       = args.column;
+    session.context      = context;
+    session.others       = others.hash();
+    session.dependencies = LibClang::Dependencies (tu);
+    session.candidates.clear();
+    for (unsigned int i = 0 ; i < completions.size() ; ++i) {
+      // Candidates without typed text can't be selected by typing a prefix
+      Candidate c = candidate (completions[i]);
+      if (!c.name.empty()) {
+        session.candidates.push_back (c);
+      }
+    }
+  }
 
-  cout << std::endl;
+  // Filter and rank candidates
+  std::vector<std::pair<long, const Candidate*>> matches;
+  for (const auto & candidate : session.candidates) {
+    const long r = rank (candidate.name, args.prefix);
+    if (r >= 0) {
+      matches.push_back (std::make_pair (r, &candidate));
+    }
+  }
+  std::stable_sort (matches.begin(), matches.end(),
+                    [](const std::pair<long, const Candidate*> & a,
+                       const std::pair<long, const Candidate*> & b) {
+                      if (a.first != b.first)
+                        return a.first < b.first;
+                      if (a.second->priority != b.second->priority)
+                        return a.second->priority < b.second->priority;
+                      return a.second->name < b.second->name;
+                    });
+  if (args.limit > 0 && matches.size() > (size_t)args.limit) {
+    matches.resize (args.limit);
+  }
 
-  int n = completions.size();
-  for (int i = 0 ; i != n ; ++i)
-    printCompletionResult (completions[i], cout);
+  Json::FastWriter writer;
+  for (const auto & match : matches) {
+    const Candidate & candidate = *match.second;
+    Json::Value json;
+    json["name"]      = candidate.name;
+    json["kind"]      = candidate.kind;
+    json["type"]      = candidate.type;
+    json["signature"] = candidate.signature;
+    json["priority"]  = candidate.priority;
+    cout << writer.write (json);
+  }
 }
@@ -6,16 +6,19 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include <vector>
 
-void displayRefDef (const Storage::RefDef & refDef, std::ostream & cout)
+void displayRefDef (const Storage::RefDef & refDef, const SourceFile & sourceFile,
+                    std::ostream & cout)
 {
   const Storage::Reference  & ref = refDef.ref;
   const Storage::Definition & def = refDef.def;
 
   // Display reference
   {
-    SourceFile sourceFile (ref.file);
-
     cout << "-- " << sourceFile.substring (ref.offset1, ref.offset2) << " -- "
          << ref.kind << " " << ref.spelling
          << std::endl;
@@ -33,25 +36,26 @@ void displayRefDef (const Storage::RefDef & refDef, std::ostream & cout)
   }
 }
 
-void outputRefDef (const Storage::RefDef & refDef, std::ostream & cout)
+void outputRefDef (const Storage::RefDef & refDef, const SourceFile & sourceFile,
+                   std::ostream & cout)
 {
   Json::FastWriter writer;
   Json::Value json = refDef.json();
 
   const Storage::Reference & ref = refDef.ref;
-  SourceFile sourceFile (ref.file);
   json["ref"]["substring"] = sourceFile.substring (ref.offset1, ref.offset2);
 
   cout << writer.write (json);
 }
 
-void displayCursor (LibClang::Cursor cursor, std::ostream & cout)
+bool displayCursor (LibClang::Cursor cursor, LibClang::FileCache & files,
+                    SourceFiles & sources, std::ostream & cout)
 {
   const LibClang::SourceLocation location (cursor.location());
   const LibClang::Cursor cursorDef = cursor.referenced();
 
   if (cursorDef.isNull()) {
-    return;
+    return false;
   }
 
   Storage::RefDef refDef;
@@ -60,9 +64,13 @@ void displayCursor (LibClang::Cursor cursor, std::ostream & cout)
 
   // Get cursor information
   {
-    const LibClang::SourceLocation::Position begin = location.expansionLocation();
-    const LibClang::SourceLocation::Position end = cursor.end().expansionLocation();
+    const LibClang::SourceLocation::Position begin = location.expansionLocation(files);
+    const LibClang::SourceLocation::Position end = cursor.end().expansionLocation(files);
     ref.file = begin.file;
+    ref.line1 = begin.line;
+    ref.line2 = end.line;
+    ref.col1 = begin.column;
+    ref.col2 = end.column;
     ref.offset1 = begin.offset;
     ref.offset2 = end.offset;
     ref.kind = cursor.kindStr();
@@ -71,8 +79,8 @@ void displayCursor (LibClang::Cursor cursor, std::ostream & cout)
 
   // Get referenced cursor information
   {
-    const LibClang::SourceLocation::Position begin = cursorDef.location().expansionLocation();
-    const LibClang::SourceLocation::Position end = cursorDef.end().expansionLocation();
+    const LibClang::SourceLocation::Position begin = cursorDef.location().expansionLocation(files);
+    const LibClang::SourceLocation::Position end = cursorDef.end().expansionLocation(files);
     def.file = begin.file;
     def.line1 = begin.line;
     def.line2 = end.line;
@@ -83,58 +91,96 @@ void displayCursor (LibClang::Cursor cursor, std::ostream & cout)
     def.usr = cursorDef.USR();
   }
 
-  outputRefDef (refDef, cout);
+  outputRefDef (refDef, *sources.get (ref.file), cout);
+  return true;
 }
 
-class FindDefinition : public LibClang::Visitor<FindDefinition>
+// Collect the cursors whose extent contains a target location.
+//
+// Only cursors enclosing the target are recursed into, so that the traversal
+// follows a single path from the translation unit down to the most specific
+// cursor, instead of visiting the whole AST.
+class EnclosingCursors : public LibClang::Visitor<EnclosingCursors>
 {
 public:
-  FindDefinition (const LibClang::SourceLocation & targetLocation,
-                  std::ostream & cout)
-    : targetLocation_ (targetLocation),
-      cout_ (cout)
+  EnclosingCursors (const LibClang::SourceLocation::Position & target,
+                    LibClang::FileCache & files)
+    : target_ (target),
+      files_ (files)
   {}
 
   CXChildVisitResult visit (LibClang::Cursor cursor,
                             LibClang::Cursor parent)
   {
-    const LibClang::SourceLocation location (cursor.location());
-
-    // Skip unexposed cursor kinds
-    if (cursor.isUnexposed()) {
-      return CXChildVisit_Recurse;
+    const LibClang::SourceLocation::Position begin = cursor.begin().expansionLocation (files_);
+    if (begin.fileId != target_.fileId || begin.offset > target_.offset) {
+      return CXChildVisit_Continue;
     }
 
-    if (location == targetLocation_) {
-      displayCursor (cursor, cout_);
+    const LibClang::SourceLocation::Position end = cursor.end().expansionLocation (files_);
+    if (end.offset < target_.offset) {
+      return CXChildVisit_Continue;
     }
 
+    cursors_.push_back (std::make_pair (end.offset - begin.offset, cursor));
     return CXChildVisit_Recurse;
   }
 
+  // Enclosing cursors, from the most specific to the least specific one
+  std::vector<LibClang::Cursor> cursors () const {
+    // Children are visited after their parents: reverse the traversal order
+    // so that inner cursors come first among cursors of the same extent
+    std::vector<std::pair<unsigned int, LibClang::Cursor>> sorted (cursors_.rbegin(),
+                                                                    cursors_.rend());
+    std::stable_sort (sorted.begin(), sorted.end(),
+                      [](const std::pair<unsigned int, LibClang::Cursor> & a,
+                         const std::pair<unsigned int, LibClang::Cursor> & b) {
+                        return a.first < b.first;
+                      });
+
+    std::vector<LibClang::Cursor> ret;
+    for (const auto & cursor : sorted) {
+      ret.push_back (cursor.second);
+    }
+    return ret;
+  }
+
 private:
-  const LibClang::SourceLocation & targetLocation_;
-  std::ostream & cout_;
+  const LibClang::SourceLocation::Position & target_;
+  LibClang::FileCache & files_;
+  std::vector<std::pair<unsigned int, LibClang::Cursor>> cursors_;
 };
 
 void Application::findDefinitionFromIndex_ (FindDefinitionArgs & args, std::ostream & cout) {
-  const auto refDefs = storage_.findDefinition (args.fileName, args.offset);
+  Reader storage (*this);
+  auto transaction (storage->beginTransaction());
+
+  const auto refDefs = references_.findDefinition (*storage, args.fileName, args.offset);
+  const auto sourceFile = sources_.get (args.fileName);
   auto refDef = refDefs.begin();
-  const auto end = args.mostSpecific
+  const auto end = (args.mostSpecific && !refDefs.empty())
     ? refDef + 1
     : refDefs.end();
   for ( ; refDef != end ; ++refDef ) {
-    outputRefDef (*refDef, cout);
+    outputRefDef (*refDef, *sourceFile, cout);
   }
 }
 
 void Application::findDefinitionFromSource_ (FindDefinitionArgs & args, std::ostream & cout) {
-  std::string directory;
-  std::vector<std::string> clArgs;
-  storage_.getCompileCommand (args.fileName, directory, clArgs);
-
-  LibClang::Index index;
-  LibClang::TranslationUnit tu = index.parse (clArgs);
+  std::lock_guard<std::mutex> lock (parseMutex_);
+
+  // Translation units are kept in memory between requests, and only reparsed
+  // when their source files or unsaved buffers change. Other translation units
+  // are loaded from the on-disk cache if possible, even after a restart.
+  LibClang::UnsavedFiles unsaved = buffers_.unsavedFiles();
+  std::unique_ptr<LibClang::TranslationUnit> loaded;
+  if (!tu_.contains (args.fileName) && unsaved.size() == 0) {
+    std::string directory;
+    std::vector<std::string> clArgs;
+    Reader (*this)->getCompileCommand (args.fileName, directory, clArgs);
+    loaded.reset (new LibClang::TranslationUnit (ast_.get (index_, directory, clArgs)));
+  }
+  LibClang::TranslationUnit & tu = loaded ? *loaded : translationUnit_ (args.fileName, unsaved);
 
   // Print clang diagnostics if requested
   if (args.diagnostics) {
@@ -144,15 +190,26 @@ void Application::findDefinitionFromSource_ (FindDefinitionArgs & args, std::ost
     }
   }
 
-  // Print cursor definition
-  LibClang::Cursor cursor (tu, args.fileName.c_str(), args.offset);
-  if (args.mostSpecific) {
-    displayCursor (cursor, cout);
+  // Print definitions of the cursors enclosing the target location, most
+  // specific first
+  const LibClang::SourceLocation::Position target
+    = tu.getLocation (args.fileName.c_str(), args.offset).expansionLocation (tu.files());
+  if (target.file == "") {
+    return;
   }
-  else {
-    LibClang::SourceLocation target = cursor.location();
-    FindDefinition findDef (target, cout);
-    findDef.visitChildren (tu.cursor());
+
+  EnclosingCursors enclosing (target, tu.files());
+  enclosing.visitChildren (tu.cursor());
+
+  for (const auto & cursor : enclosing.cursors()) {
+    // Skip unexposed cursor kinds
+    if (cursor.isUnexposed()) {
+      continue;
+    }
+
+    if (displayCursor (cursor, tu.files(), sources_, cout) && args.mostSpecific) {
+      break;
+    }
   }
 }
 
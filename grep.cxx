@@ -4,13 +4,21 @@
 void Application::grep (const GrepArgs & args, std::ostream & cout) {
   Json::FastWriter writer;
 
-  const auto refs = storage_.grep (args.usr);
+  Reader storage (*this);
+  auto transaction (storage->beginTransaction());
+
+  // References come grouped by file: each file is only looked up once
+  const auto refs = storage->grep (args.usr);
+  std::shared_ptr<const SourceFile> file;
   auto ref = refs.begin ();
   const auto end = refs.end ();
   for ( ; ref != end ; ++ref ) {
+    if (ref == refs.begin() || ref->file != (ref-1)->file) {
+      file = sources_.get (ref->file);
+    }
+
     Json::Value json = ref->json();
-    SourceFile file (ref->file);
-    json["lineContents"] = file.line (ref->line1);
+    json["lineContents"] = file->line (ref->line1);
     cout << writer.write (json);
   }
 }
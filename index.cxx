@@ -2,135 +2,639 @@
 #include "getopt++/getopt.hxx"
 
 #include "util/util.hxx"
+#include "util/allocations.hxx"
 #include "application.hxx"
 
 #include <cstdlib>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <set>
+#include <deque>
 
-class Indexer : public LibClang::Visitor<Indexer> {
-public:
-  Indexer (const std::string & fileName,
-           const std::vector<std::string> & exclude,
-           Storage & storage,
-           std::ostream & cout)
-    : sourceFile_ (fileName),
-      exclude_    (exclude),
-      storage_    (storage),
-      cout_       (cout)
-  {
-    needsUpdate_[fileName] = storage.beginFile (fileName);
-    storage_.addInclude (fileName, fileName);
-  }
+namespace {
+  // Files claimed for indexing during an indexing run
+  //
+  // This registry is shared by all indexing workers: the first worker to
+  // encounter an out-of-date file claims it, and is the only one to collect
+  // tags for it.
+  //
+  // Files with an unsaved editor buffer are always claimed, but their tags
+  // match no file on disk: they are stored as never indexed, so that the next
+  // update indexes them again (e.g. once the buffer is saved or closed).
+  class FileClaims {
+  public:
+    FileClaims (const std::map<std::string, Storage::FileState> & indexed,
+                const LibClang::UnsavedFiles & unsaved)
+      : indexed_ (indexed)
+    {
+      for (unsigned int i = 0 ; i < unsaved.size() ; ++i) {
+        buffered_.insert (unsaved.sourcePath (i));
+      }
+    }
 
-  CXChildVisitResult visit (LibClang::Cursor cursor,
-                            LibClang::Cursor parent)
-  {
-    const LibClang::Cursor cursorDef (cursor.referenced());
+    // Claim a file if it needs to be re-indexed; its current state is then
+    // stored in `state`
+    bool claim (const std::string & fileName, Storage::FileState & state) {
+      // Each file is checked only once during a run. Reading its state (which
+      // may involve hashing its contents) is done without holding the lock,
+      // so that workers entering different files don't wait for each other.
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        if (!checked_.insert (fileName).second) {
+          return false;
+        }
+      }
 
-    // Skip non-reference cursors
-    if (cursorDef.isNull()) {
-      return CXChildVisit_Recurse;
+      // indexed_ is never modified: it can be read concurrently
+      Storage::FileState indexed;
+      auto indexedIt = indexed_.find (fileName);
+      if (indexedIt != indexed_.end()) {
+        indexed = indexedIt->second;
+      }
+
+      if (!state.read (fileName, indexed)) {
+        return false;
+      }
+
+      if (buffered_.count (fileName) > 0) {
+        state.modified = 0;
+        return true;
+      }
+      return state.changedSince (indexed);
+    }
+
+  private:
+    const std::map<std::string, Storage::FileState> indexed_;
+    std::set<std::string>                           buffered_;
+    std::set<std::string>                           checked_;
+    std::mutex                                      mutex_;
+  };
+
+
+  // Translation unit to be indexed
+  struct IndexJob {
+    std::string              fileName;
+    std::string              directory;
+    std::vector<std::string> args;
+  };
+
+
+  // Everything collected by a worker while indexing a translation unit
+  //
+  // Tags are kept in a compact form, so that collecting them does not
+  // allocate memory: USRs and spellings are interned in a per-TU string
+  // pool, and kinds are kept as libclang enumerators. They are converted to
+  // Storage::Tag by store().
+  struct IndexResult {
+    struct Tag {
+      unsigned int usr;           // id in `strings`
+      unsigned int spelling;      // id in `strings`
+      CXCursorKind kind;
+      int line1;
+      int col1;
+      int offset1;
+      int line2;
+      int col2;
+      int offset2;
+      bool isDeclaration;
+    };
+
+    struct File {
+      std::string        name;
+      bool               claimed;
+      Storage::FileState state;
+      std::vector<Tag>   tags;
+    };
+
+    std::string       fileName;
+    std::vector<File> files;
+    StringPool        strings;
+    std::string       log;
+    std::string       error;
+  };
+
+
+  // Tags collected from a translation unit, sorted by file
+  //
+  // Per-file decisions are taken once, the first time a file is seen:
+  // excluded files are ignored, and other files are claimed for this
+  // translation unit if they need to be re-indexed.
+  class TagCollector {
+  public:
+    TagCollector (IndexResult & result,
+                  const PrefixSet & exclude,
+                  FileClaims & claims,
+                  LibClang::FileCache & files,
+                  std::ostream & cout)
+      : result_  (result),
+        exclude_ (exclude),
+        claims_  (claims),
+        files_   (files),
+        cout_    (cout)
+    {
+      addFile_ (result_.fileName);
+    }
+
+    LibClang::FileCache & files () {
+      return files_;
+    }
+
+    // Result entry for a file (identified by its id in the FileCache), or
+    // NULL if the file is excluded
+    IndexResult::File * file (unsigned int fileId) {
+      if (fileId >= fileIndex_.size()) {
+        fileIndex_.resize (fileId + 1, UNKNOWN);
+      }
+      int & fileIndex = fileIndex_[fileId];
+      if (fileIndex == UNKNOWN) {
+        fileIndex = resolveFile_ (files_.name (fileId));
+      }
+
+      if (fileIndex == EXCLUDED) {
+        return NULL;
+      }
+      return &(result_.files[fileIndex]);
+    }
+
+    // Record a tag for a cursor declaring or referencing `usr`
+    void add (IndexResult::File & file,
+              const LibClang::Cursor & cursor,
+              const LibClang::SourceLocation::Position & begin,
+              const char * usr)
+    {
+      const LibClang::SourceLocation::Position end = cursor.end().expansionPosition (files_);
+      IndexResult::Tag tag;
+      tag.usr      = result_.strings.id (usr);
+      tag.spelling = result_.strings.id (cursor.spellingView().c_str());
+      tag.kind     = cursor.kind();
+      tag.line1    = begin.line;
+      tag.col1     = begin.column;
+      tag.offset1  = begin.offset;
+      tag.line2    = end.line;
+      tag.col2     = end.column;
+      tag.offset2  = end.offset;
+      tag.isDeclaration = cursor.isDeclaration();
+      file.tags.push_back (tag);
+    }
+
+  private:
+    typedef std::map<std::string, unsigned int> FileMap;
+
+    enum { UNKNOWN = -2, EXCLUDED = -1 };
+
+    int resolveFile_ (const std::string & fileName) {
+      if (fileName == "" || exclude_.matches (fileName.c_str())) {
+        return EXCLUDED;
+      }
+
+      auto file = names_.find (fileName);
+      if (file == names_.end()) {
+        cout_ << "    " << fileName << std::endl;
+        file = addFile_ (fileName);
+      }
+      return file->second;
     }
 
-    const std::string usr = cursorDef.USR();
-    if (usr == "") {
+    FileMap::iterator addFile_ (const std::string & fileName) {
+      IndexResult::File file;
+      file.name    = fileName;
+      file.claimed = claims_.claim (fileName, file.state);
+      result_.files.push_back (file);
+      return names_.insert (std::make_pair (fileName, result_.files.size() - 1)).first;
+    }
+
+    IndexResult                    & result_;
+    const PrefixSet                & exclude_;
+    FileClaims                     & claims_;
+    LibClang::FileCache            & files_;
+    FileMap                          names_;
+    std::vector<int>                 fileIndex_;
+    std::ostream                   & cout_;
+  };
+
+
+  // "visitor" engine: traverse the whole AST of a parsed translation unit,
+  // looking for cursors which reference something
+  class Indexer : public LibClang::Visitor<Indexer> {
+  public:
+    Indexer (TagCollector & tags)
+      : tags_    (tags),
+        visited_ (0)
+    { }
+
+    unsigned long visited () const {
+      return visited_;
+    }
+
+    CXChildVisitResult visit (LibClang::Cursor cursor,
+                              LibClang::Cursor parent)
+    {
+      ++visited_;
+      const LibClang::Cursor cursorDef (cursor.referenced());
+
+      // Skip non-reference cursors
+      if (cursorDef.isNull()) {
+        return CXChildVisit_Recurse;
+      }
+
+      const LibClang::CString usr = cursorDef.USRView();
+      if (usr.empty()) {
+        return CXChildVisit_Recurse;
+      }
+
+      const LibClang::SourceLocation::Position begin = cursor.location().expansionPosition (tags_.files());
+      IndexResult::File * file = tags_.file (begin.fileId);
+      if (!file) {
+        return CXChildVisit_Continue;
+      }
+
+      if (file->claimed) {
+        tags_.add (*file, cursor, begin, usr.c_str());
+      }
+
       return CXChildVisit_Recurse;
     }
 
-    const LibClang::SourceLocation::Position begin = cursor.location().expansionLocation();
-    const String fileName = begin.file;
+  private:
+    TagCollector & tags_;
+    unsigned long  visited_;
+  };
+
+
+  // "callbacks" engine: let libclang report declarations and references
+  // while parsing the translation unit.
+  //
+  // Files are claimed when they are entered, before any of their function
+  // bodies get parsed. Since the IndexAction only skips bodies which another
+  // translation unit has finished parsing before this one started, a claimed
+  // file is always fully indexed.
+  class CallbacksIndexer : public LibClang::IndexerCallbacks<CallbacksIndexer> {
+  public:
+    CallbacksIndexer (TagCollector & tags, bool diagnostics, std::ostream & cout)
+      : tags_        (tags),
+        diagnostics_ (diagnostics),
+        cout_        (cout)
+    { }
 
-    if (fileName == "") {
-      return CXChildVisit_Continue;
+    void enteredMainFile (CXFile file) {
+      see_ (file);
     }
 
-    { // Skip excluded paths
-      auto it  = exclude_.begin();
-      auto end = exclude_.end();
-      for ( ; it != end ; ++it) {
-        if (fileName.startsWith (*it)) {
-          return CXChildVisit_Continue;
-        }
+    void includedFile (CXFile file) {
+      see_ (file);
+    }
+
+    void declaration (LibClang::Cursor cursor, const char * usr) {
+      add_ (cursor, usr);
+    }
+
+    void reference (LibClang::Cursor cursor, const char * usr) {
+      add_ (cursor, usr);
+    }
+
+    void diagnostic (const std::string & message) {
+      if (diagnostics_) {
+        cout_ << message << std::endl << std::endl;
       }
     }
 
-    if (needsUpdate_.count(fileName) == 0) {
-      cout_ << "    " << fileName << std::endl;
-      needsUpdate_[fileName] = storage_.beginFile (fileName);
-      storage_.addInclude (fileName, sourceFile_);
+  private:
+    void see_ (CXFile file) {
+      tags_.file (tags_.files().get (file).id);
     }
 
-    if (needsUpdate_[fileName]) {
-      const LibClang::SourceLocation::Position end = cursor.end().expansionLocation();
-      storage_.addTag (usr, cursor.kindStr(), cursor.spelling(), fileName,
-                       begin.line, begin.column, begin.offset,
-                       end.line,   end.column,   end.offset,
-                       cursor.isDeclaration());
+    void add_ (const LibClang::Cursor & cursor, const char * usr) {
+      const LibClang::SourceLocation::Position begin = cursor.location().expansionPosition (tags_.files());
+      IndexResult::File * file = tags_.file (begin.fileId);
+      if (file && file->claimed) {
+        tags_.add (*file, cursor, begin, usr);
+      }
     }
 
-    return CXChildVisit_Recurse;
-  }
+    TagCollector & tags_;
+    const bool     diagnostics_;
+    std::ostream & cout_;
+  };
+
+
+  // Pool of indexing workers
+  //
+  // With the "visitor" engine, each worker owns its own LibClang::Index and
+  // parses translation units independently. With the "callbacks" engine, all
+  // workers share a single IndexAction for the whole run. Results are handed
+  // back through a queue, so that only the thread owning the Storage writes
+  // to the database. Unsaved editor buffers are parsed in place of the files
+  // on disk.
+  class IndexWorkers {
+  public:
+    typedef std::shared_ptr<IndexJob>    Job;
+    typedef std::shared_ptr<IndexResult> Result;
+
+    IndexWorkers (unsigned int size,
+                  const Application::IndexArgs & args,
+                  LibClang::Index::ParseMode mode,
+                  const LibClang::UnsavedFiles & unsaved,
+                  FileClaims & claims)
+      : args_    (args),
+        exclude_ (args.exclude),
+        mode_    (mode),
+        unsaved_ (unsaved),
+        claims_  (claims)
+    {
+      if (args_.engine == "callbacks") {
+        action_.reset (new LibClang::IndexAction (LibClang::Index()));
+      }
 
-private:
-  const std::string              & sourceFile_;
-  const std::vector<std::string> & exclude_;
-  Storage                        & storage_;
-  std::map<std::string, bool>      needsUpdate_;
-  std::ostream                   & cout_;
-};
+      for (unsigned int i = 0 ; i < size ; ++i) {
+        workers_.push_back (std::thread (&IndexWorkers::work_, this));
+      }
+    }
+
+    ~IndexWorkers () {
+      // Null jobs tell workers to stop
+      for (unsigned int i = 0 ; i < workers_.size() ; ++i) {
+        jobs_.push (Job());
+      }
+      for (auto & worker : workers_) {
+        worker.join();
+      }
+    }
+
+    unsigned int size () const {
+      return workers_.size();
+    }
+
+    void push (const Job & job) {
+      jobs_.push (job);
+    }
+
+    Result pop () {
+      return results_.pop();
+    }
+
+  private:
+    void work_ () {
+      LibClang::Index index;
+      LibClang::UnsavedFiles unsaved (unsaved_);
+      Job job;
+      while ((job = jobs_.pop())) {
+        Result result (new IndexResult);
+        result->fileName = job->fileName;
+
+        std::ostringstream cout;
+        try {
+          index_ (index, unsaved, *job, *result, cout);
+        } catch (std::exception & e) {
+          result->error = e.what();
+        }
+        result->log = cout.str();
+
+        results_.push (result);
+      }
+    }
+
+    void index_ (LibClang::Index & index, LibClang::UnsavedFiles & unsaved,
+                 const IndexJob & job,
+                 IndexResult & result, std::ostream & cout) {
+      // Compile commands were made independent of the working directory when
+      // they were loaded (see CompileCommand::normalize)
+      const std::vector<std::string> & clArgs = job.args;
+
+      if (action_) {
+        cout << job.fileName << ":" << std::endl
+             << "  indexing..." << std::endl;
+        Timer timer;
+
+        LibClang::FileCache files;
+        TagCollector tags (result, exclude_, claims_, files, cout);
+        CallbacksIndexer indexer (tags, args_.diagnostics, cout);
+        if (!action_->index (clArgs, unsaved, mode_, indexer)) {
+          throw std::runtime_error ("could not parse " + job.fileName);
+        }
+        cout << "  indexing...\t" << timer.get() << "s." << std::endl;
+        return;
+      }
+
+      cout << job.fileName << ":" << std::endl
+           << "  parsing..." << std::flush;
+      Timer timer;
+
+      LibClang::TranslationUnit tu = index.parse (clArgs, unsaved, mode_);
+
+      cout << "\t" << timer.get() << "s." << std::endl;
+      timer.reset();
+
+      // Print clang diagnostics if requested
+      if (args_.diagnostics) {
+        for (unsigned int N = tu.numDiagnostics(),
+               i = 0 ; i < N ; ++i) {
+          cout << tu.diagnostic (i) << std::endl << std::endl;
+        }
+      }
+
+      cout << "  indexing..." << std::endl;
+      LibClang::Cursor top (tu);
+      TagCollector tags (result, exclude_, claims_, tu.files(), cout);
+      Indexer indexer (tags);
+      AllocationCounter allocations;
+      indexer.visitChildren (top);
+      cout << "  indexing...\t" << timer.get() << "s. ("
+           << indexer.visited() << " cursors, "
+           << allocations.get() << " allocations)" << std::endl;
+    }
+
+    const Application::IndexArgs & args_;
+    const PrefixSet                exclude_;
+    const LibClang::Index::ParseMode mode_;
+    const LibClang::UnsavedFiles   unsaved_;
+    FileClaims                   & claims_;
+    std::unique_ptr<LibClang::IndexAction> action_;
+    Queue<Job>                     jobs_;
+    Queue<Result>                  results_;
+    std::vector<std::thread>       workers_;
+  };
+
+
+  void store (const IndexResult & result, Storage & storage) {
+    std::map<CXCursorKind, std::string> kinds;
+
+    auto file = result.files.begin();
+    auto end  = result.files.end();
+    for ( ; file != end ; ++file) {
+      const int fileId = storage.addFile (file->name);
+      if (file->claimed) {
+        storage.beginFile (file->name, file->state);
+      }
+      storage.addInclude (file->name, result.fileName);
+
+      auto tag    = file->tags.begin();
+      auto tagEnd = file->tags.end();
+      for ( ; tag != tagEnd ; ++tag) {
+        auto kind = kinds.find (tag->kind);
+        if (kind == kinds.end()) {
+          kind = kinds.insert (std::make_pair (tag->kind,
+                                               LibClang::Cursor::kindStr (tag->kind))).first;
+        }
+
+        Storage::Tag storageTag;
+        storageTag.usr      = result.strings.get (tag->usr);
+        storageTag.kind     = kind->second;
+        storageTag.spelling = result.strings.get (tag->spelling);
+        storageTag.line1    = tag->line1;
+        storageTag.col1     = tag->col1;
+        storageTag.offset1  = tag->offset1;
+        storageTag.line2    = tag->line2;
+        storageTag.col2     = tag->col2;
+        storageTag.offset2  = tag->offset2;
+        storageTag.isDeclaration = tag->isDeclaration;
+        storage.addTag (fileId, storageTag);
+      }
+    }
+    storage.flushTags();
+  }
+}
 
 
 
 void Application::index (IndexArgs & args, std::ostream & cout) {
+  std::lock_guard<std::mutex> lock (writeMutex_);
+
+  if (args.engine != "visitor" && args.engine != "callbacks") {
+    cout << "Unknown indexing engine: `" << args.engine << "'" << std::endl;
+    return;
+  }
+
   cout << std::endl
        << "-- Indexing project" << std::endl;
   storage_.setOption ("exclude", args.exclude);
-  storage_.cleanIndex();
+  storage_.setOption ("engine",  args.engine);
+  if (args.deferIndexes) {
+    storage_.beginBulkIndex();
+  } else {
+    storage_.cleanIndex();
+  }
+  references_.clear();
 
   updateIndex_ (args, cout);
+
+  if (args.deferIndexes) {
+    cout << "-- Building indexes" << std::endl;
+    Timer timer;
+    try {
+      storage_.endBulkIndex();
+      cout << timer.get() << "s." << std::endl;
+    } catch (Sqlite::Error & e) {
+      cout << "  error: could not build indexes: " << e.what() << std::endl;
+    }
+  }
+
+  watchFiles_ ();
 }
 
 void Application::update (IndexArgs & args, std::ostream & cout) {
+  std::lock_guard<std::mutex> lock (writeMutex_);
+
   cout << std::endl
        << "-- Updating index" << std::endl;
   args.exclude = storage_.getOption ("exclude", Storage::Vector());
+  args.engine  = storage_.getOption ("engine", "visitor");
 
   updateIndex_ (args, cout);
+  watchFiles_ ();
 }
 
 void Application::updateIndex_ (IndexArgs & args, std::ostream & cout) {
   Timer totalTimer;
+  unsigned int indexed = 0;
+  unsigned long tags   = 0;
 
   {
     auto transaction(storage_.beginTransaction());
-    std::string fileName;
-    while ((fileName = storage_.nextFile()) != "") {
-      cout << fileName << ":" << std::endl
-           << "  parsing..." << std::flush;
-      Timer timer;
 
-      LibClang::TranslationUnit tu = translationUnit_(fileName);
+    std::deque<std::string> plan;
+    {
+      const std::vector<std::string> stale = storage_.staleSources ();
+      plan.insert (plan.end(), stale.begin(), stale.end());
+    }
 
-      cout << "\t" << timer.get() << "s." << std::endl;
-      timer.reset();
+    // Workers are only started if there is something to do
+    if (!plan.empty()) {
+      const LibClang::UnsavedFiles unsaved = buffers_.unsavedFiles();
+      FileClaims claims (storage_.indexedFiles(), unsaved);
+      IndexWorkers workers (args.jobs > 0 ? args.jobs : jobs_, args,
+                            skipBodies_ ? LibClang::Index::Indexing : LibClang::Index::Default,
+                            unsaved, claims);
 
-      // Print clang diagnostics if requested
-      if (args.diagnostics) {
-        for (unsigned int N = tu.numDiagnostics(),
-               i = 0 ; i < N ; ++i) {
-          cout << tu.diagnostic (i) << std::endl << std::endl;
-        }
+      // Translation units handled during this run are never dispatched twice.
+      // Modified files stay out of date once stored: they must not cause
+      // other translation units to be planned.
+      std::set<std::string> handled;
+      for (unsigned int i = 0 ; i < unsaved.size() ; ++i) {
+        handled.insert (unsaved.sourcePath (i));
       }
+      unsigned int pending = 0;
+      while (true) {
+        if (plan.empty() && pending == 0) {
+          // Plan again once everything has been stored: the inclusion graph
+          // may have changed, or some translation units may have failed to
+          // parse. In most cases, this second plan is empty.
+          const std::vector<std::string> stale = storage_.staleSources (handled);
+          plan.insert (plan.end(), stale.begin(), stale.end());
+          if (plan.empty()) {
+            break;
+          }
+        }
 
-      cout << "  indexing..." << std::endl;
-      LibClang::Cursor top (tu);
-      Indexer indexer (fileName, args.exclude, storage_, cout);
-      indexer.visitChildren (top);
-      cout << "  indexing...\t" << timer.get() << "s." << std::endl;
+        // Keep all workers busy
+        while (pending < workers.size() && !plan.empty()) {
+          const std::string fileName = plan.front();
+          plan.pop_front();
+          handled.insert (fileName);
+
+          IndexWorkers::Job job (new IndexJob);
+          job->fileName = fileName;
+          storage_.getCompileCommand (fileName, job->directory, job->args);
+          workers.push (job);
+          ++pending;
+        }
+
+        // Store results in the order in which they are produced
+        IndexWorkers::Result result = workers.pop();
+        --pending;
+
+        cout << result->log;
+        if (result->error != "") {
+          cout << "  error: " << result->error << std::endl;
+          continue;
+        }
+        store (*result, storage_);
+
+        ++indexed;
+        for (const auto & file : result->files) {
+          tags += file.tags.size();
+        }
+      }
     }
   }
 
-  cout << totalTimer.get() << "s." << std::endl;
+  // Forget cached references to the files whose tags were just committed
+  references_.invalidate (storage_.modifiedFiles());
+
+  // Strings interned during this run are only useful to this run: don't let
+  // the writer keep every USR and spelling ever seen in memory
+  storage_.forgetCaches();
+
+  // Throughput of the indexing engine (see tests/bench-index)
+  const double time = totalTimer.get();
+  if (indexed > 0) {
+    cout << "-- " << indexed << " translation units, " << tags << " tags"
+         << " (" << args.engine << " engine): "
+         << indexed / time << " TU/s, " << tags / time << " tags/s" << std::endl;
+  }
+  cout << time << "s." << std::endl;
 }
@@ -0,0 +1,233 @@
+#include "astCache.hxx"
+#include "index.hxx"
+#include "translationUnit.hxx"
+#include "dependencies.hxx"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+
+namespace LibClang {
+  namespace {
+    std::string absolutePath (const std::string & fileName) {
+      char * path = realpath (fileName.c_str(), NULL);
+      if (path == NULL) {
+        return fileName;
+      }
+      std::string res (path);
+      free (path);
+      return res;
+    }
+  }
+
+  AstCache::AstCache (const std::string & directory, unsigned long sizeLimit)
+    : directory_ (directory),
+      sizeLimit_ (sizeLimit),
+      hits_ (0),
+      misses_ (0)
+  {
+    if (sizeLimit_ > 0) {
+      mkdir (directory_.c_str(), 0755);
+      directory_ = absolutePath (directory_);
+
+      // The size limit may have been lowered since the last run
+      evict_ ();
+    }
+  }
+
+  TranslationUnit AstCache::get (const Index & index,
+                                 const std::string & directory,
+                                 const std::vector<std::string> & args) {
+    if (sizeLimit_ == 0) {
+      ++misses_;
+      return index.parse (args);
+    }
+
+    const std::string entry = entry_ (directory, args);
+    if (valid_ (entry, directory, args)) {
+      CXTranslationUnit tu;
+      if (clang_createTranslationUnit2 (index.raw(), (entry + ".ast").c_str(), &tu)
+          == CXError_Success) {
+        ++hits_;
+
+        // Entries are evicted in least recently used order
+        utimensat (AT_FDCWD, (entry + ".ast").c_str(), NULL, 0);
+        return TranslationUnit (tu);
+      }
+    }
+
+    ++misses_;
+    remove_ (entry);
+    TranslationUnit tu = index.parse (args);
+    save_ (entry, directory, args, tu);
+    return tu;
+  }
+
+  TranslationUnit AstCache::get (const Index & index,
+                                 const std::string & directory,
+                                 const std::vector<std::string> & args,
+                                 UnsavedFiles & unsaved) {
+    if (unsaved.size() > 0) {
+      ++misses_;
+      return index.parse (args, unsaved);
+    }
+    return get (index, directory, args);
+  }
+
+  unsigned long AstCache::hits () const {
+    return hits_;
+  }
+
+  unsigned long AstCache::misses () const {
+    return misses_;
+  }
+
+  std::string AstCache::entry_ (const std::string & directory,
+                                const std::vector<std::string> & args) const {
+    // 64-bit FNV-1a hash of the compilation command. Relative paths in the
+    // arguments are resolved against the directory, which is thus part of
+    // the key.
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char c : directory) {
+      hash ^= c;
+      hash *= 1099511628211ULL;
+    }
+    hash *= 1099511628211ULL;
+    for (const auto & arg : args) {
+      for (unsigned char c : arg) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+      }
+      // Arguments are separated by a null character
+      hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream entry;
+    entry << directory_ << "/" << std::hex << std::setw (16) << std::setfill ('0') << hash;
+    return entry.str();
+  }
+
+  bool AstCache::valid_ (const std::string & entry,
+                         const std::string & directory,
+                         const std::vector<std::string> & args) const {
+    std::ifstream deps (entry + ".deps");
+    if (!deps) {
+      return false;
+    }
+
+    // Compilation command (in case of hash collisions)
+    std::string savedDirectory;
+    std::getline (deps, savedDirectory);
+    if (!deps || savedDirectory != directory) {
+      return false;
+    }
+    unsigned int argc;
+    deps >> argc;
+    deps.ignore (1);
+    if (!deps || argc != args.size()) {
+      return false;
+    }
+    for (const auto & arg : args) {
+      std::string line;
+      std::getline (deps, line);
+      if (line != arg) {
+        return false;
+      }
+    }
+
+    // Source files
+    Dependencies dependencies;
+    Dependencies::File file;
+    while (std::getline (deps, file.name) && deps >> file.modified >> file.size) {
+      deps.ignore (1);
+      dependencies.add (file);
+    }
+    return deps.eof() && dependencies.upToDate();
+  }
+
+  void AstCache::save_ (const std::string & entry,
+                        const std::string & directory,
+                        const std::vector<std::string> & args,
+                        const TranslationUnit & tu) {
+    if (tu.raw() == NULL) {
+      return;
+    }
+
+    // Source files are recorded before saving the AST, so that any
+    // concurrent modification invalidates the entry
+    const Dependencies dependencies (tu);
+
+    {
+      std::ofstream deps (entry + ".deps.tmp");
+      deps << directory << std::endl
+           << args.size() << std::endl;
+      for (const auto & arg : args) {
+        deps << arg << std::endl;
+      }
+      for (const auto & file : dependencies.files()) {
+        if (file.modified == -1) {
+          deps.close();
+          unlink ((entry + ".deps.tmp").c_str());
+          return;
+        }
+        deps << file.name << std::endl
+             << file.modified << " " << file.size << std::endl;
+      }
+    }
+
+    if (clang_saveTranslationUnit (tu.raw(), (entry + ".ast").c_str(),
+                                   clang_defaultSaveOptions (tu.raw()))
+        != CXSaveError_None) {
+      unlink ((entry + ".deps.tmp").c_str());
+      remove_ (entry);
+      return;
+    }
+    rename ((entry + ".deps.tmp").c_str(), (entry + ".deps").c_str());
+
+    evict_ ();
+  }
+
+  void AstCache::remove_ (const std::string & entry) const {
+    unlink ((entry + ".ast").c_str());
+    unlink ((entry + ".deps").c_str());
+  }
+
+  void AstCache::evict_ () const {
+    DIR * dir = opendir (directory_.c_str());
+    if (dir == NULL) {
+      return;
+    }
+
+    // Entries, sorted by last use
+    std::multimap<long long, std::pair<std::string, long long>> entries;
+    unsigned long total = 0;
+    while (struct dirent * file = readdir (dir)) {
+      const std::string name = file->d_name;
+      const std::string suffix = ".ast";
+      if (name.size() <= suffix.size()
+          || name.compare (name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        continue;
+      }
+
+      const std::string entry = directory_ + "/" + name.substr (0, name.size() - suffix.size());
+      const Dependencies::File ast = Dependencies::state (entry + ".ast");
+      if (ast.modified != -1) {
+        entries.insert (std::make_pair (ast.modified, std::make_pair (entry, ast.size)));
+        total += ast.size;
+      }
+    }
+    closedir (dir);
+
+    for (auto it = entries.begin() ; total > sizeLimit_ && it != entries.end() ; ++it) {
+      remove_ (it->second.first);
+      total -= it->second.second;
+    }
+  }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <clang-c/Index.h>
+#include "unsavedFiles.hxx"
+#include <string>
+#include <vector>
+
+namespace LibClang {
+  /** @addtogroup libclang
+      @{
+  */
+
+  // Forward declarations
+  class Index;
+  class TranslationUnit;
+
+  /** @brief Persistent cache of translation units
+   *
+   * Translation units are saved as AST files in a cache directory, so that
+   * they can be loaded instead of parsed again, even after a restart.
+   *
+   * Entries are keyed by the compilation command (arguments and working
+   * directory), and record the state (modification time and size) of all
+   * source files used by the translation unit: an entry is only used when
+   * none of them changed. Content hashes would not help here: when loading an
+   * AST file, libclang itself rejects it if the modification time of any of
+   * its inputs changed.
+   *
+   * The total size of the cache is limited: least recently used entries are
+   * evicted first.
+   *
+   * @note Translation units loaded from AST files can be inspected (e.g. by
+   * visiting their cursors), but neither be reparsed nor used for code
+   * completion.
+   */
+  class AstCache {
+  public:
+    /** @brief Constructor
+     *
+     * @param directory  path to the cache directory (created if needed)
+     * @param sizeLimit  maximum size of the cache (in bytes). A limit of 0
+     *                   disables the cache.
+     */
+    AstCache (const std::string & directory, unsigned long sizeLimit);
+
+    /** @brief Get a translation unit, from the cache if possible
+     *
+     * If an up-to-date entry exists for the compilation command, the
+     * translation unit is loaded from it. Otherwise, the source file is parsed
+     * and the resulting translation unit is saved in the cache.
+     *
+     * @param index      index used to load or parse the translation unit
+     * @param directory  directory in which the compilation command is run
+     * @param args       compilation command
+     *
+     * @return the TranslationUnit
+     */
+    TranslationUnit get (const Index & index, const std::string & directory,
+                         const std::vector<std::string> & args);
+
+    /** @brief Get a translation unit, from the cache if possible
+     *
+     * Translation units depending on unsaved contents are never cached: if the
+     * set of unsaved files is not empty, the source file is always parsed.
+     *
+     * @param index      index used to load or parse the translation unit
+     * @param directory  directory in which the compilation command is run
+     * @param args       compilation command
+     * @param unsaved    set of unsaved contents for the source files
+     *
+     * @return the TranslationUnit
+     */
+    TranslationUnit get (const Index & index, const std::string & directory,
+                         const std::vector<std::string> & args,
+                         UnsavedFiles & unsaved);
+
+    /** @brief Get the number of translation units loaded from the cache */
+    unsigned long hits () const;
+
+    /** @brief Get the number of translation units which had to be parsed */
+    unsigned long misses () const;
+
+  private:
+    std::string entry_ (const std::string & directory,
+                        const std::vector<std::string> & args) const;
+    bool valid_ (const std::string & entry, const std::string & directory,
+                 const std::vector<std::string> & args) const;
+    void save_ (const std::string & entry, const std::string & directory,
+                const std::vector<std::string> & args, const TranslationUnit & tu);
+    void remove_ (const std::string & entry) const;
+    void evict_ () const;
+
+    std::string         directory_;
+    const unsigned long sizeLimit_;
+    unsigned long       hits_;
+    unsigned long       misses_;
+  };
+
+  /** @} */
+}
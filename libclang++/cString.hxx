@@ -0,0 +1,62 @@
+#pragma once
+
+#include <clang-c/Index.h>
+
+namespace LibClang {
+  /** @addtogroup libclang
+      @{
+  */
+
+  /** @brief String returned by libclang
+   *
+   * This class owns a libclang @c CXString, and gives access to its characters
+   * without copying them to a std::string.
+   */
+  class CString {
+  public:
+    /** @brief Constructor
+     *
+     * @param raw  libclang string, which will be disposed of by this object
+     */
+    explicit CString (CXString raw)
+      : raw_ (raw)
+    { }
+
+    CString (CString && other)
+      : raw_ (other.raw_)
+    {
+      other.raw_.data = NULL;
+    }
+
+    ~CString () {
+      if (raw_.data) {
+        clang_disposeString (raw_);
+      }
+    }
+
+    CString (const CString &) = delete;
+    CString & operator= (const CString &) = delete;
+
+    /** @brief Get the characters of the string
+     *
+     * @return a C string, valid for the lifetime of this object
+     */
+    const char * c_str () const {
+      const char * str = clang_getCString (raw_);
+      return str ? str : "";
+    }
+
+    /** @brief Determine whether the string is empty
+     *
+     * @return true if the string is empty (or null)
+     */
+    bool empty () const {
+      return c_str()[0] == '\0';
+    }
+
+  private:
+    CXString raw_;
+  };
+
+  /** @} */
+}
@@ -39,31 +39,42 @@ namespace LibClang {
   }
 
   std::string Cursor::kindStr () const {
-    CXCursorKind kind = clang_getCursorKind (raw());
-    CXString kindSpelling = clang_getCursorKindSpelling (kind);
-    std::string res = clang_getCString (kindSpelling);
-    clang_disposeString (kindSpelling);
-    return res;
+    return kindStr (kind());
+  }
+
+  CXCursorKind Cursor::kind () const {
+    return clang_getCursorKind (raw());
+  }
+
+  std::string Cursor::kindStr (CXCursorKind kind) {
+    return CString (clang_getCursorKindSpelling (kind)).c_str();
   }
 
   std::string Cursor::spelling () const {
-    CXString cursorSpelling = clang_getCursorSpelling (raw());
-    std::string res = clang_getCString (cursorSpelling);
-    clang_disposeString (cursorSpelling);
-    return res;
+    return spellingView().c_str();
+  }
+
+  CString Cursor::spellingView () const {
+    return CString (clang_getCursorSpelling (raw()));
   }
 
   std::string Cursor::USR () const {
-    CXString cursorUSR = clang_getCursorUSR (raw());
-    std::string res = clang_getCString (cursorUSR);
-    clang_disposeString (cursorUSR);
-    return res;
+    return USRView().c_str();
+  }
+
+  CString Cursor::USRView () const {
+    return CString (clang_getCursorUSR (raw()));
   }
 
   SourceLocation Cursor::location () const {
     return clang_getCursorLocation (raw());
   }
 
+  SourceLocation Cursor::begin () const {
+    CXSourceRange extent = clang_getCursorExtent (raw());
+    return clang_getRangeStart (extent);
+  }
+
   SourceLocation Cursor::end () const {
     CXSourceRange extent = clang_getCursorExtent (raw());
     return clang_getRangeEnd (extent);
@@ -1,5 +1,6 @@
 #pragma once
 #include <clang-c/Index.h>
+#include "cString.hxx"
 #include <string>
 
 namespace LibClang {
@@ -95,12 +96,32 @@ namespace LibClang {
      */
     std::string kindStr () const;
 
+    /** @brief Get the kind of cursor
+     *
+     * @return the cursor kind, as a libclang enumerator
+     */
+    CXCursorKind kind () const;
+
+    /** @brief Get the name of a cursor kind
+     *
+     * @param kind  the cursor kind
+     *
+     * @return the kind name, as returned by kindStr()
+     */
+    static std::string kindStr (CXCursorKind kind);
+
     /** @brief Get the name of the entity referred to
      *
      * @return the name of the referenced entity, as a string
      */
     std::string spelling () const;
 
+    /** @brief Get the name of the entity referred to, without copying it
+     *
+     * @return the name of the referenced entity, as a CString
+     */
+    CString spellingView () const;
+
     /** @brief Get the Unified Symbol Resolution for the entity referenced
      *
      * A Unified Symbol Resolution (USR) is a string that identifies a
@@ -113,6 +134,12 @@ namespace LibClang {
      */
     std::string USR () const;
 
+    /** @brief Get the Unified Symbol Resolution, without copying it
+     *
+     * @return the USR, as a CString
+     */
+    CString USRView () const;
+
     /** @brief Get the source location associated to a cursor
      *
      * The location returned corresponds to the first character of the
@@ -123,6 +150,17 @@ namespace LibClang {
      */
     SourceLocation location () const;
 
+    /** @brief Get the source location of the beginning of a cursor extent
+     *
+     * The location returned corresponds to the first character of the whole
+     * extent of the entity in the source code, which may differ from
+     * location() (e.g. for a function declaration, location() points to the
+     * function name, and begin() to the return type).
+     *
+     * @return a SourceLocation to the beginning of the entity extent
+     */
+    SourceLocation begin () const;
+
     /** @brief Get the source location associated to a cursor
      *
      * The location returned corresponds to the last character of the referenced
@@ -145,6 +183,8 @@ namespace LibClang {
                                              CXClientData client_data);
     template <typename VISITOR>
     friend class Visitor;
+    template <typename CALLBACKS>
+    friend class IndexerCallbacks;
   };
 
   /** @} */
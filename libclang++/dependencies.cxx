@@ -0,0 +1,66 @@
+#include "dependencies.hxx"
+#include "translationUnit.hxx"
+
+#include <sys/stat.h>
+#include <set>
+
+namespace LibClang {
+  namespace {
+    void addInclusion (CXFile file, CXSourceLocation*, unsigned int,
+                       CXClientData data) {
+      auto & args = *static_cast<std::pair<FileCache*, std::set<std::string>*>*> (data);
+      args.second->insert (args.first->get (file).name);
+    }
+  }
+
+  Dependencies::File Dependencies::state (const std::string & fileName) {
+    File file;
+    file.name = fileName;
+
+    struct stat fileStat;
+    if (stat (fileName.c_str(), &fileStat) != 0) {
+      file.modified = -1;
+      file.size = 0;
+      return file;
+    }
+
+    file.modified = (long long)fileStat.st_mtim.tv_sec * 1000000000
+      + fileStat.st_mtim.tv_nsec;
+    file.size = fileStat.st_size;
+    return file;
+  }
+
+  Dependencies::Dependencies ()
+  { }
+
+  Dependencies::Dependencies (const TranslationUnit & tu) {
+    // File names are canonical paths, so that the state of files can be
+    // checked from any working directory
+    std::set<std::string> fileNames;
+    std::pair<FileCache*, std::set<std::string>*> args (&tu.files(), &fileNames);
+    clang_getInclusions (tu.raw(), addInclusion, &args);
+
+    for (const auto & fileName : fileNames) {
+      files_.push_back (state (fileName));
+    }
+  }
+
+  void Dependencies::add (const File & file) {
+    files_.push_back (file);
+  }
+
+  const std::vector<Dependencies::File> & Dependencies::files () const {
+    return files_;
+  }
+
+  bool Dependencies::upToDate () const {
+    for (const auto & file : files_) {
+      const File current = state (file.name);
+      if (file.modified == -1 || current.modified != file.modified
+          || current.size != file.size) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace LibClang {
+  /** @addtogroup libclang
+      @{
+  */
+
+  // Forward declaration
+  class TranslationUnit;
+
+  /** @brief Source files used by a translation unit
+   *
+   * This is a snapshot of the state (modification time and size) of all source
+   * files included by a translation unit. It allows determining whether the
+   * translation unit is still up-to-date, without reparsing it.
+   */
+  class Dependencies {
+  public:
+    /** @brief State of a source file */
+    struct File {
+      std::string name;         /**< @brief canonical file path */
+      long long   modified;     /**< @brief modification time (in ns), or -1 if the file can't be read */
+      long long   size;         /**< @brief file size (in bytes) */
+    };
+
+    /** @brief Get the current state of a file
+     *
+     * @param fileName  path to the file
+     *
+     * @return the File state
+     */
+    static File state (const std::string & fileName);
+
+    /** @brief Constructor for an empty set of dependencies
+     */
+    Dependencies ();
+
+    /** @brief Constructor
+     *
+     * Record the current state of all source files included by a translation
+     * unit.
+     *
+     * @param tu  the TranslationUnit
+     */
+    explicit Dependencies (const TranslationUnit & tu);
+
+    /** @brief Add a source file
+     *
+     * @param file  the file state, as recorded when the translation unit was parsed
+     */
+    void add (const File & file);
+
+    /** @brief Get the list of source files
+     *
+     * @return the recorded state of all files
+     */
+    const std::vector<File> & files () const;
+
+    /** @brief Check whether all source files are unchanged
+     *
+     * @return true if all files still have the same modification time and size
+     */
+    bool upToDate () const;
+
+  private:
+    std::vector<File> files_;
+  };
+
+  /** @} */
+}
@@ -0,0 +1,58 @@
+#include "fileCache.hxx"
+#include <stdlib.h>
+
+namespace LibClang {
+  FileCache::FileCache ()
+    : lastFile_ (NULL),
+      last_     (NULL)
+  { }
+
+  const FileCache::File & FileCache::get (CXFile file) {
+    if (last_ && file == lastFile_) {
+      return *last_;
+    }
+
+    auto it = files_.find (file);
+    if (it != files_.end()) {
+      lastFile_ = file;
+      last_     = &(it->second);
+      return it->second;
+    }
+
+    File res;
+    res.id = files_.size();
+
+    CXString fileName = clang_getFileName (file);
+    if (clang_getCString (fileName)) {
+      char * canonicalPath = realpath (clang_getCString (fileName), NULL);
+      if (canonicalPath) {
+        res.name = canonicalPath;
+        free (canonicalPath);
+      } else {
+        res.name = clang_getCString (fileName);
+      }
+    }
+    clang_disposeString (fileName);
+
+    const File & inserted = files_.insert (std::make_pair (file, res)).first->second;
+    byId_.push_back (&inserted);
+    lastFile_ = file;
+    last_     = &inserted;
+    return inserted;
+  }
+
+  const std::string & FileCache::name (unsigned int id) const {
+    return byId_[id]->name;
+  }
+
+  unsigned int FileCache::size () const {
+    return files_.size();
+  }
+
+  void FileCache::clear () {
+    files_.clear();
+    byId_.clear();
+    lastFile_ = NULL;
+    last_     = NULL;
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <clang-c/Index.h>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace LibClang {
+  /** @addtogroup libclang
+      @{
+  */
+
+  /** @brief Cache of source files in a translation unit
+   *
+   * Resolving a libclang @c CXFile to a canonical path involves a call to
+   * @c realpath(), which is expensive when done for every cursor in the
+   * AST. This cache resolves each distinct file only once, and associates it
+   * to an id which is stable for the lifetime of the cache.
+   *
+   * @c CXFile handles are only valid within the translation unit they come
+   * from: each TranslationUnit owns its own cache (see
+   * TranslationUnit::files()).
+   */
+  class FileCache {
+  public:
+    /** @brief Source file information */
+    struct File {
+      std::string  name;        /**< @brief canonical file path */
+      unsigned int id;          /**< @brief id, counted from 0 in order of first appearance */
+    };
+
+    /** @brief Constructor for an empty cache
+     */
+    FileCache ();
+
+    FileCache (const FileCache &) = delete;
+    FileCache & operator= (const FileCache &) = delete;
+
+    /** @brief Get information about a source file
+     *
+     * @param file  libclang file handle
+     *
+     * @return the File information
+     */
+    const File & get (CXFile file);
+
+    /** @brief Get the name of a source file
+     *
+     * @param id  file id, as found in the File information
+     *
+     * @return the canonical file path
+     */
+    const std::string & name (unsigned int id) const;
+
+    /** @brief Get the number of files in the cache
+     *
+     * All file ids are lower than this number.
+     *
+     * @return the number of distinct files resolved so far
+     */
+    unsigned int size () const;
+
+    /** @brief Empty the cache
+     *
+     * This must be called whenever @c CXFile handles are invalidated,
+     * e.g. when the translation unit is reparsed.
+     */
+    void clear ();
+
+  private:
+    std::map<CXFile, File>    files_;
+    std::vector<const File *> byId_;
+
+    // Consecutive lookups are very likely to be for the same file
+    CXFile                    lastFile_;
+    const File *              last_;
+  };
+
+  /** @} */
+}
@@ -1,18 +1,33 @@
 #include "index.hxx"
 #include "translationUnit.hxx"
 
+#include <chrono>
+#include <mutex>
+
 namespace LibClang {
+  namespace {
+    std::mutex          statisticsMutex;
+    Index::Statistics   modeStatistics[3];
+  }
+
   Index::Index ()
     : index_ (new Index_ (clang_createIndex (0, 0)))
   { }
 
-  TranslationUnit Index::parse (int argc, char const *const *const argv) const {
-    return clang_createTranslationUnitFromSourceFile (raw(), 0,
-                                                      argc, argv,
-                                                      0, 0);
+  TranslationUnit Index::parse (int argc, char const *const *const argv,
+                                ParseMode mode) const {
+    return parse_ (argc, argv, NULL, mode);
   }
 
-  TranslationUnit Index::parse (const std::vector<std::string> & args) const {
+  TranslationUnit Index::parse (const std::vector<std::string> & args,
+                                ParseMode mode) const {
+    UnsavedFiles unsaved;
+    return parse (args, unsaved, mode);
+  }
+
+  TranslationUnit Index::parse (const std::vector<std::string> & args,
+                                UnsavedFiles & unsaved,
+                                ParseMode mode) const {
     std::vector<const char*> args_c;
     auto i   = args.begin();
     auto end = args.end();
@@ -20,7 +35,64 @@ namespace LibClang {
       args_c.push_back (i->c_str());
     }
 
-    return parse (args_c.size(), &(args_c[0]));
+    return parse_ (args_c.size(), &(args_c[0]), &unsaved, mode);
+  }
+
+  TranslationUnit Index::parse_ (int argc, char const *const *const argv,
+                                 UnsavedFiles * unsaved, ParseMode mode) const {
+    const auto start = std::chrono::steady_clock::now();
+
+    CXTranslationUnit tu;
+    if (clang_parseTranslationUnit2 (raw(), 0,
+                                     argv, argc,
+                                     unsaved ? unsaved->begin() : NULL,
+                                     unsaved ? unsaved->size() : 0,
+                                     parseOptions_ (mode),
+                                     &tu) != CXError_Success) {
+      tu = NULL;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    record_ (mode, false, elapsed.count());
+
+    return TranslationUnit (tu, mode);
+  }
+
+  unsigned int Index::parseOptions_ (ParseMode mode) {
+    // Same options as clang_createTranslationUnitFromSourceFile
+    unsigned int options = CXTranslationUnit_DetailedPreprocessingRecord;
+
+    switch (mode) {
+    case Default:
+      break;
+    case Editing:
+      options |= CXTranslationUnit_PrecompiledPreamble
+        | CXTranslationUnit_CreatePreambleOnFirstParse
+        | CXTranslationUnit_CacheCompletionResults;
+      break;
+    case Indexing:
+      options |= CXTranslationUnit_SkipFunctionBodies;
+      break;
+    }
+
+    return options;
+  }
+
+  Index::Statistics Index::statistics (ParseMode mode) {
+    std::lock_guard<std::mutex> lock (statisticsMutex);
+    return modeStatistics[mode];
+  }
+
+  void Index::record_ (ParseMode mode, bool reparse, double seconds) {
+    std::lock_guard<std::mutex> lock (statisticsMutex);
+    Statistics & stats = modeStatistics[mode];
+    if (reparse) {
+      ++stats.reparses;
+      stats.reparseTime += seconds;
+    } else {
+      ++stats.parses;
+      stats.parseTime += seconds;
+    }
   }
 
   const CXIndex & Index::raw () const {
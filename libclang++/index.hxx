@@ -1,6 +1,7 @@
 #pragma once
 
 #include <clang-c/Index.h>
+#include "unsavedFiles.hxx"
 #include <memory>
 #include <vector>
 #include <string>
@@ -19,6 +20,44 @@ namespace LibClang {
    */
   class Index {
   public:
+    /** @brief Parsing modes
+     *
+     * Translation units can be parsed with different options, depending on how
+     * they are going to be used.
+     */
+    enum ParseMode {
+      /** @brief Translation units used once, for navigation purposes */
+      Default,
+
+      /** @brief Translation units which will be reparsed and used for code
+       * completion
+       *
+       * A precompiled preamble is built when first parsing the translation
+       * unit, so that headers do not need to be processed again when
+       * reparsing it. Code completion results are cached.
+       */
+      Editing,
+
+      /** @brief Translation units which are only parsed to be indexed
+       *
+       * Function bodies are skipped, so that references inside them are not
+       * seen.
+       */
+      Indexing
+    };
+
+    /** @brief Parsing statistics
+     *
+     * Statistics are accumulated for each parsing mode, over all Index
+     * instances.
+     */
+    struct Statistics {
+      unsigned long parses;       ///< number of parsed translation units
+      double        parseTime;    ///< total parsing time (in seconds)
+      unsigned long reparses;     ///< number of reparsed translation units
+      double        reparseTime;  ///< total reparsing time (in seconds)
+    };
+
     /** @brief default constructor
      */
     Index ();
@@ -30,10 +69,12 @@ namespace LibClang {
      *
      * @param argc  The number of command-line arguments
      * @param argv  A C-style array of command-line arguments
+     * @param mode  The parsing mode
      *
      * @return The corresponfing TranslationUnit object
      */
-    TranslationUnit parse (int argc, char const *const *const argv) const;
+    TranslationUnit parse (int argc, char const *const *const argv,
+                           ParseMode mode = Default) const;
 
     /** @brief Create a translation unit from a command-line
      *
@@ -41,13 +82,44 @@ namespace LibClang {
      * command-line arguments which would be passed to the compiler.
      *
      * @param args  A vector of command-line arguments
+     * @param mode  The parsing mode
+     *
+     * @return The corresponfing TranslationUnit object
+     */
+    TranslationUnit parse (const std::vector<std::string> & args,
+                           ParseMode mode = Default) const;
+
+    /** @brief Create a translation unit from a command-line and unsaved files
+     *
+     * Return the translation unit for a given source file and the provided
+     * command-line arguments which would be passed to the compiler. Contents
+     * of the source files are read from the set of in-memory buffers in
+     * @em unsaved when available.
+     *
+     * @param args     A vector of command-line arguments
+     * @param unsaved  A set of unsaved contents for the source files
+     * @param mode     The parsing mode
      *
      * @return The corresponfing TranslationUnit object
      */
-    TranslationUnit parse (const std::vector<std::string> & args) const;
+    TranslationUnit parse (const std::vector<std::string> & args,
+                           UnsavedFiles & unsaved,
+                           ParseMode mode = Default) const;
+
+    /** @brief Get parsing statistics
+     *
+     * @param mode  The parsing mode
+     *
+     * @return Statistics about all translation units parsed in this mode
+     */
+    static Statistics statistics (ParseMode mode);
 
   private:
     const CXIndex & raw() const;
+    TranslationUnit parse_ (int argc, char const *const *const argv,
+                            UnsavedFiles * unsaved, ParseMode mode) const;
+    static unsigned int parseOptions_ (ParseMode mode);
+    static void record_ (ParseMode mode, bool reparse, double seconds);
     struct Index_ {
       CXIndex index_;
       Index_ (CXIndex index) : index_ (index) {}
@@ -55,6 +127,11 @@ namespace LibClang {
     };
 
     std::shared_ptr<Index_> index_;
+
+    // Friend declarations
+    friend class TranslationUnit;
+    friend class AstCache;
+    friend class IndexAction;
   };
 
   /** @} */
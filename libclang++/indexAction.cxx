@@ -0,0 +1,41 @@
+#include "indexAction.hxx"
+
+#include <chrono>
+
+namespace LibClang {
+  IndexAction::IndexAction (const Index & index)
+    : index_  (index),
+      action_ (new IndexAction_ (clang_IndexAction_create (index.raw())))
+  { }
+
+  bool IndexAction::indexSourceFile_ (const std::vector<std::string> & args,
+                                      UnsavedFiles & unsaved,
+                                      Index::ParseMode mode,
+                                      ::IndexerCallbacks & callbacks,
+                                      CXClientData data) {
+    std::vector<const char*> args_c;
+    auto i   = args.begin();
+    auto end = args.end();
+    for ( ; i != end ; ++i) {
+      args_c.push_back (i->c_str());
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // References to local symbols are indexed, as they are by a full AST
+    // traversal
+    const int res = clang_indexSourceFile (action_->action_, data,
+                                           &callbacks, sizeof (callbacks),
+                                           CXIndexOpt_SkipParsedBodiesInSession
+                                           | CXIndexOpt_IndexFunctionLocalSymbols,
+                                           0, &(args_c[0]), args_c.size(),
+                                           unsaved.begin(), unsaved.size(),
+                                           NULL,
+                                           Index::parseOptions_ (mode));
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Index::record_ (mode, false, elapsed.count());
+
+    return res == 0;
+  }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <clang-c/Index.h>
+#include "index.hxx"
+#include "cursor.hxx"
+#include "unsavedFiles.hxx"
+#include <string>
+#include <vector>
+
+namespace LibClang {
+  /** @addtogroup libclang
+      @{
+  */
+
+  /** @brief Base class for indexer callbacks
+   *
+   * This class provides the interface used by IndexAction to report the
+   * entities found while indexing a translation unit. Every class used to
+   * receive these callbacks should derive from this using a CRTP, and hide the
+   * methods it is interested in. The default methods do nothing.
+   *
+   * @code
+   * class MyCallbacks : public LibClang::IndexerCallbacks<MyCallbacks> {
+   * public:
+   *   void reference (LibClang::Cursor cursor, const char * usr) {
+   *     std::cerr << usr << std::endl;
+   *   }
+   * };
+   * @endcode
+   */
+  template <typename CALLBACKS>
+  class IndexerCallbacks {
+  public:
+    /** @brief Called when the main source file is entered
+     *
+     * @param file  the main file
+     */
+    void enteredMainFile (CXFile file) { }
+
+    /** @brief Called when a file is included
+     *
+     * This is called before the contents of the file are parsed.
+     *
+     * @param file  the included file
+     */
+    void includedFile (CXFile file) { }
+
+    /** @brief Called for each (explicit) declaration
+     *
+     * @param cursor  the declaration
+     * @param usr     USR of the declared entity (never empty)
+     */
+    void declaration (Cursor cursor, const char * usr) { }
+
+    /** @brief Called for each reference to an entity
+     *
+     * @param cursor  the referencing cursor
+     * @param usr     USR of the referenced entity (never empty)
+     */
+    void reference (Cursor cursor, const char * usr) { }
+
+    /** @brief Called for each compiler diagnostic
+     *
+     * @param message  the formatted diagnostic message
+     */
+    void diagnostic (const std::string & message) { }
+
+  private:
+    static CALLBACKS & self_ (CXClientData data) {
+      return *((CALLBACKS*)data);
+    }
+
+    static CXIdxClientFile enteredMainFile_ (CXClientData data, CXFile file, void*) {
+      self_(data).enteredMainFile (file);
+      return NULL;
+    }
+
+    static CXIdxClientFile ppIncludedFile_ (CXClientData data,
+                                            const CXIdxIncludedFileInfo * info) {
+      self_(data).includedFile (info->file);
+      return NULL;
+    }
+
+    static void indexDeclaration_ (CXClientData data, const CXIdxDeclInfo * info) {
+      if (info->isImplicit || !info->entityInfo
+          || !info->entityInfo->USR || !info->entityInfo->USR[0]) {
+        return;
+      }
+      self_(data).declaration (Cursor (info->cursor), info->entityInfo->USR);
+    }
+
+    static void indexEntityReference_ (CXClientData data, const CXIdxEntityRefInfo * info) {
+      if (!info->referencedEntity
+          || !info->referencedEntity->USR || !info->referencedEntity->USR[0]) {
+        return;
+      }
+      self_(data).reference (Cursor (info->cursor), info->referencedEntity->USR);
+    }
+
+    static void diagnostic_ (CXClientData data, CXDiagnosticSet diagnostics, void*) {
+      for (unsigned int N = clang_getNumDiagnosticsInSet (diagnostics),
+             i = 0 ; i < N ; ++i) {
+        CXDiagnostic diagnostic = clang_getDiagnosticInSet (diagnostics, i);
+        CXString string = clang_formatDiagnostic (diagnostic,
+                                                  clang_defaultDiagnosticDisplayOptions());
+        self_(data).diagnostic (clang_getCString (string));
+        clang_disposeString (string);
+        clang_disposeDiagnostic (diagnostic);
+      }
+    }
+
+    static ::IndexerCallbacks raw_ () {
+      ::IndexerCallbacks callbacks = {};
+      callbacks.diagnostic           = diagnostic_;
+      callbacks.enteredMainFile      = enteredMainFile_;
+      callbacks.ppIncludedFile       = ppIncludedFile_;
+      callbacks.indexDeclaration     = indexDeclaration_;
+      callbacks.indexEntityReference = indexEntityReference_;
+      return callbacks;
+    }
+
+    // Friend declaration
+    friend class IndexAction;
+  };
+
+
+  /** @brief Indexing session
+   *
+   * This class is a proxy for libclang's @c CXIndexAction type. It parses
+   * translation units and reports the entities they declare and reference,
+   * without building a full AST which would then have to be traversed.
+   *
+   * All translation units indexed with the same IndexAction belong to the
+   * same session: function bodies in headers are only parsed by the first
+   * translation unit including them, and skipped in all others. Translation
+   * units can be indexed concurrently from several threads.
+   */
+  class IndexAction {
+  public:
+    /** @brief Constructor
+     *
+     * @param index  the Index in which translation units are parsed
+     */
+    explicit IndexAction (const Index & index);
+
+    /** @brief Index a translation unit
+     *
+     * Parse a source file, given the command-line arguments which would be
+     * passed to the compiler, and report its contents to @em callbacks.
+     * Contents of the source files are read from the set of in-memory buffers
+     * in @em unsaved when available.
+     *
+     * @param args       A vector of command-line arguments
+     * @param unsaved    A set of unsaved contents for the source files
+     * @param mode       The parsing mode
+     * @param callbacks  The callbacks object
+     *
+     * @return true if the translation unit could be parsed
+     */
+    template <typename CALLBACKS>
+    bool index (const std::vector<std::string> & args,
+                UnsavedFiles & unsaved,
+                Index::ParseMode mode,
+                IndexerCallbacks<CALLBACKS> & callbacks) {
+      ::IndexerCallbacks raw = IndexerCallbacks<CALLBACKS>::raw_();
+      return indexSourceFile_ (args, unsaved, mode, raw, (CALLBACKS*)&callbacks);
+    }
+
+  private:
+    bool indexSourceFile_ (const std::vector<std::string> & args,
+                           UnsavedFiles & unsaved,
+                           Index::ParseMode mode,
+                           ::IndexerCallbacks & callbacks,
+                           CXClientData data);
+
+    struct IndexAction_ {
+      CXIndexAction action_;
+      IndexAction_ (CXIndexAction action) : action_ (action) {}
+      ~IndexAction_ () { clang_IndexAction_dispose (action_); }
+    };
+
+    Index                          index_;
+    std::shared_ptr<IndexAction_>  action_;
+  };
+
+  /** @} */
+}
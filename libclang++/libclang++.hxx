@@ -1,9 +1,14 @@
 #pragma once
 
 #include "index.hxx"
+#include "indexAction.hxx"
 #include "translationUnit.hxx"
+#include "astCache.hxx"
 #include "cursor.hxx"
+#include "cString.hxx"
 #include "sourceLocation.hxx"
+#include "fileCache.hxx"
+#include "dependencies.hxx"
 #include "visitor.hxx"
 
 /** @addtogroup libclang LibClang++
@@ -1,4 +1,5 @@
 #include "sourceLocation.hxx"
+#include "fileCache.hxx"
 #include "config.h"
 #include <stdlib.h>
 
@@ -16,8 +17,7 @@ namespace LibClang {
     return location_;
   }
 
-  const SourceLocation::Position SourceLocation::expansionLocation () const {
-    Position res;
+  CXFile SourceLocation::expansionLocation_ (Position & res) const {
     CXFile file;
 
 #ifdef HAVE_CLANG_GETEXPANSIONLOCATION
@@ -28,6 +28,14 @@ namespace LibClang {
     clang_getInstantiationLocation (raw(), &file, &res.line, &res.column, &res.offset);
 #endif
 
+    return file;
+  }
+
+  const SourceLocation::Position SourceLocation::expansionLocation () const {
+    Position res;
+    CXFile file = expansionLocation_ (res);
+    res.fileId = 0;
+
     CXString fileName = clang_getFileName (file);
     if (clang_getCString (fileName)) {
       char * canonicalPath = realpath (clang_getCString (fileName), NULL);
@@ -37,4 +45,18 @@ namespace LibClang {
     clang_disposeString (fileName);
     return res;
   }
+
+  const SourceLocation::Position SourceLocation::expansionLocation (FileCache & files) const {
+    Position res;
+    const FileCache::File & file = files.get (expansionLocation_ (res));
+    res.file   = file.name;
+    res.fileId = file.id;
+    return res;
+  }
+
+  const SourceLocation::Position SourceLocation::expansionPosition (FileCache & files) const {
+    Position res;
+    res.fileId = files.get (expansionLocation_ (res)).id;
+    return res;
+  }
 }
@@ -7,6 +7,9 @@ namespace LibClang {
       @{
   */
 
+  // Forward declaration
+  class FileCache;
+
   /** @brief Location in the source code
    *
    * This class is a proxy for libclang's @c CXSourceLocation type. It should
@@ -30,6 +33,7 @@ namespace LibClang {
      */
     struct Position {
       std::string file;         /**< @brief file name */
+      unsigned int fileId;      /**< @brief file id in the FileCache, if one was used */
       unsigned int line;        /**< @brief line number */
       unsigned int column;      /**< @brief column number */
       unsigned int offset;      /**< @brief offset in characters since the file beginning */
@@ -52,7 +56,33 @@ namespace LibClang {
      */
     const Position expansionLocation () const;
 
+    /** @brief Get the associated physical position
+     *
+     * Same as expansionLocation(), except file names are resolved through the
+     * provided cache, which should be the FileCache of the translation unit
+     * this location belongs to.
+     *
+     * @param files  cache of source files
+     *
+     * @return a Position structure
+     */
+    const Position expansionLocation (FileCache & files) const;
+
+    /** @brief Get the associated physical position, without the file name
+     *
+     * Same as expansionLocation(FileCache&), except the file is only
+     * identified by its id in the cache: the file name is left empty, which
+     * avoids copying it. Use FileCache::name() to retrieve it.
+     *
+     * @param files  cache of source files
+     *
+     * @return a Position structure
+     */
+    const Position expansionPosition (FileCache & files) const;
+
   private:
+    CXFile expansionLocation_ (Position & res) const;
+
     SourceLocation (CXSourceLocation raw);
     CXSourceLocation location_;
     const CXSourceLocation & raw () const;
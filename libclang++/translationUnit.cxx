@@ -3,20 +3,30 @@
 #include "sourceLocation.hxx"
 #include "cursor.hxx"
 
+#include <chrono>
+
 namespace LibClang {
-  TranslationUnit::TranslationUnit (CXTranslationUnit tu)
-    : translationUnit_ (new TranslationUnit_ (tu))
+  TranslationUnit::TranslationUnit (CXTranslationUnit tu, Index::ParseMode mode)
+    : translationUnit_ (new TranslationUnit_ (tu, mode))
   { }
 
   void TranslationUnit::reparse () {
+    files().clear();
+    const auto start = std::chrono::steady_clock::now();
     clang_reparseTranslationUnit (raw(), 0, 0,
                                   clang_defaultReparseOptions(raw()));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Index::record_ (translationUnit_->mode_, true, elapsed.count());
   }
 
   void TranslationUnit::reparse (UnsavedFiles & unsaved) {
+    files().clear();
+    const auto start = std::chrono::steady_clock::now();
     clang_reparseTranslationUnit (raw(),
                                   unsaved.size(), unsaved.begin(),
                                   clang_defaultReparseOptions(raw()));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Index::record_ (translationUnit_->mode_, true, elapsed.count());
   }
 
   SourceLocation TranslationUnit::getLocation (const char* fileName, unsigned int offset) {
@@ -59,6 +69,10 @@ namespace LibClang {
     return total;
   }
 
+  FileCache & TranslationUnit::files () const {
+    return translationUnit_->files_;
+  }
+
   const CXTranslationUnit & TranslationUnit::raw () const {
     return translationUnit_->translationUnit_;
   }
@@ -3,7 +3,9 @@
 #include <clang-c/Index.h>
 #include <memory>
 
+#include "index.hxx"
 #include "unsavedFiles.hxx"
+#include "fileCache.hxx"
 
 namespace LibClang {
   /** @addtogroup libclang
@@ -11,7 +13,6 @@ namespace LibClang {
   */
 
   // Forward declarations
-  class Index;
   class SourceLocation;
   class Cursor;
 
@@ -91,15 +92,27 @@ namespace LibClang {
      */
     unsigned long memoryUsage () const;
 
+    /** @brief Get the cache of source files for the translation unit
+     *
+     * The cache is shared by all copies of the TranslationUnit object, and
+     * emptied whenever the translation unit is reparsed.
+     *
+     * @return A FileCache to be used with SourceLocation::expansionLocation
+     */
+    FileCache & files () const;
+
     // TODO Make this method private
     const CXTranslationUnit & raw () const;
 
   private:
-    TranslationUnit (CXTranslationUnit tu);
+    TranslationUnit (CXTranslationUnit tu, Index::ParseMode mode = Index::Default);
 
     struct TranslationUnit_ {
       CXTranslationUnit translationUnit_;
-      TranslationUnit_ (CXTranslationUnit tu) : translationUnit_ (tu) {}
+      Index::ParseMode  mode_;
+      FileCache         files_;
+      TranslationUnit_ (CXTranslationUnit tu, Index::ParseMode mode)
+        : translationUnit_ (tu), mode_ (mode) {}
       ~TranslationUnit_ () { clang_disposeTranslationUnit (translationUnit_); }
     };
     std::shared_ptr<TranslationUnit_> translationUnit_;
@@ -107,6 +120,7 @@ namespace LibClang {
     // Friend declaration
     friend class Index;
     friend class Cursor;
+    friend class AstCache;
   };
 
   /** @} */
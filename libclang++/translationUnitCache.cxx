@@ -1,9 +1,25 @@
 #include "translationUnitCache.hxx"
 
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
 namespace LibClang {
-  TranslationUnitCache::TranslationUnitCache (unsigned long memoryLimit)
+  namespace {
+    // Number of cache accesses after which past hits count for half
+    const double hitsHalfLife = 32;
+  }
+
+  TranslationUnitCache::TranslationUnitCache (unsigned long memoryLimit,
+                                              unsigned long residentLimit)
     : memoryLimit_(memoryLimit),
-      memoryUsage_(0)
+      residentLimit_(residentLimit),
+      memoryUsage_(0),
+      time_(0),
+      misses_(0),
+      reparses_(0),
+      skips_(0)
   {
   }
 
@@ -12,31 +28,156 @@ namespace LibClang {
   }
 
   void TranslationUnitCache::insert (const std::string & fileName,
-      const TranslationUnit & tu) {
+      const TranslationUnit & tu, const UnsavedFiles & unsaved, int flags) {
 
-    memoryUsage_ += tu.memoryUsage();
-
-    // Clear out recently-used files until we have enough space for the new
-    // translation unit.
-    while (memoryUsage_ > memoryLimit_ && !lruFiles_.empty()) {
-      auto it = tunits_.find(lruFiles_.front());
-      memoryUsage_ -= it->second.first.memoryUsage();
-      tunits_.erase(it);
-      lruFiles_.pop_front();
-    }
+    ++misses_;
 
     // Add in our new translation unit. Even if the memory usage of this single
     // translation unit exceeds the memory limit, we will always insert it.
-    auto it = lruFiles_.emplace(lruFiles_.end(), fileName);
-    tunits_.emplace(fileName, std::make_pair(tu, it));
+    Entry entry = {tu, Dependencies (tu), unsaved.hash(), flags,
+                   tu.memoryUsage(), 0, time_};
+    memoryUsage_ += entry.memory;
+    tunits_.emplace(fileName, entry);
+
+    // Clear out costly translation units until we fit in the memory limits.
+    evict_(fileName);
+  }
+
+  int TranslationUnitCache::flags (const std::string & fileName) const {
+    return tunits_.at(fileName).flags;
   }
 
   TranslationUnit & TranslationUnitCache::get (const std::string & fileName) {
-    auto & entry = tunits_.find(fileName)->second;
+    auto & entry = entry_(fileName);
+
+    entry.hits = hits_(entry) + 1;
+    entry.lastHit = ++time_;
+
+    return entry.tu;
+  }
+
+  bool TranslationUnitCache::reparse (const std::string & fileName) {
+    UnsavedFiles unsaved;
+    if (!reparse_(entry_(fileName), unsaved)) {
+      return false;
+    }
+    evict_(fileName);
+    return true;
+  }
+
+  bool TranslationUnitCache::reparse (const std::string & fileName,
+                                      UnsavedFiles & unsaved) {
+    if (!reparse_(entry_(fileName), unsaved)) {
+      return false;
+    }
+    evict_(fileName);
+    return true;
+  }
+
+  void TranslationUnitCache::remove (const std::string & fileName) {
+    auto it = tunits_.find(fileName);
+    if (it == tunits_.end()) {
+      return;
+    }
+    memoryUsage_ -= it->second.memory;
+    tunits_.erase(it);
+  }
+
+  TranslationUnitCache::Statistics TranslationUnitCache::statistics () const {
+    Statistics stats;
+    stats.misses   = misses_;
+    stats.reparses = reparses_;
+    stats.skips    = skips_;
+    return stats;
+  }
+
+  std::vector<TranslationUnitCache::EntryInfo> TranslationUnitCache::entries () const {
+    std::vector<EntryInfo> res;
+    for (const auto & it : tunits_) {
+      EntryInfo info;
+      info.fileName = it.first;
+      info.flags    = it.second.flags;
+      info.memory   = it.second.memory;
+      info.hits     = hits_(it.second);
+      info.cost     = info.memory / info.hits;
+      res.push_back (info);
+    }
 
-    // Move this file to the end of the least-recently-used list.
-    lruFiles_.splice(lruFiles_.end(), lruFiles_, entry.second);
+    std::sort (res.begin(), res.end(), [](const EntryInfo & a, const EntryInfo & b) {
+        return a.cost > b.cost;
+      });
+    return res;
+  }
+
+  unsigned long TranslationUnitCache::memoryUsage () const {
+    return memoryUsage_;
+  }
 
-    return entry.first;
+  unsigned long TranslationUnitCache::residentMemory () {
+    // The second field of /proc/self/statm is the resident set size, in pages
+    unsigned long size = 0, resident = 0;
+    std::ifstream statm ("/proc/self/statm");
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+  }
+
+  TranslationUnitCache::Entry & TranslationUnitCache::entry_ (const std::string & fileName) {
+    return tunits_.find(fileName)->second;
+  }
+
+  bool TranslationUnitCache::reparse_ (Entry & entry, UnsavedFiles & unsaved) {
+    const unsigned long long hash = unsaved.hash();
+    if (hash == entry.unsaved && entry.dependencies.upToDate()) {
+      ++skips_;
+      return false;
+    }
+
+    ++reparses_;
+    entry.tu.reparse(unsaved);
+    entry.dependencies = Dependencies (entry.tu);
+    entry.unsaved = hash;
+
+    // Reparsing (especially building a precompiled preamble) changes the
+    // memory usage of the translation unit
+    memoryUsage_ -= entry.memory;
+    entry.memory = entry.tu.memoryUsage();
+    memoryUsage_ += entry.memory;
+    return true;
+  }
+
+  double TranslationUnitCache::hits_ (const Entry & entry) const {
+    // Bounded below, so that costs remain finite
+    return std::max (1e-6, entry.hits * std::pow (0.5, (time_ - entry.lastHit) / hitsHalfLife));
+  }
+
+  void TranslationUnitCache::evict_ (const std::string & keep) {
+    // Memory in excess of the process-wide limit. Memory freed by disposing
+    // translation units is not necessarily returned to the system right
+    // away, so this is computed only once.
+    unsigned long residentExcess = 0;
+    if (residentLimit_ > 0) {
+      const unsigned long resident = residentMemory();
+      if (resident > residentLimit_) {
+        residentExcess = resident - residentLimit_;
+      }
+    }
+
+    while ((memoryUsage_ > memoryLimit_ || residentExcess > 0) && tunits_.size() > 1) {
+      // Dispose the costliest translation unit (except the one in use)
+      auto victim = tunits_.end();
+      double maxCost = -1;
+      for (auto it = tunits_.begin() ; it != tunits_.end() ; ++it) {
+        const double cost = it->second.memory / hits_(it->second);
+        if (it->first != keep && cost > maxCost) {
+          victim = it;
+          maxCost = cost;
+        }
+      }
+
+      const unsigned long memory = victim->second.memory;
+      memoryUsage_ -= memory;
+      residentExcess -= std::min (residentExcess, memory);
+      tunits_.erase(victim);
+    }
   }
 }
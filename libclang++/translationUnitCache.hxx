@@ -1,7 +1,10 @@
 #pragma once
 
 #include "translationUnit.hxx"
-#include <list>
+#include "dependencies.hxx"
+#include "unsavedFiles.hxx"
+#include <atomic>
+#include <vector>
 #include <map>
 
 namespace LibClang {
@@ -11,17 +14,28 @@ namespace LibClang {
 
   /** @brief Provides caching of @c TranslationUnit instances.
    *
-   * This class provides a memory-limited cache of translation units. When the
-   * memory limit is exceeded, the least recently-used translation units are
-   * disposed.
+   * This class provides a memory-limited cache of translation units. The
+   * memory usage of each translation unit is measured whenever it is parsed
+   * or reparsed. When the memory limit is exceeded, translation units are
+   * disposed in order of decreasing cost, where the cost of a translation
+   * unit is its memory usage divided by its number of recent hits: large,
+   * rarely used translation units go first.
+   *
+   * A limit can also be set on the resident memory of the whole process,
+   * which accounts for memory not attributed to any translation unit.
+   *
+   * The source files used by each translation unit are recorded, so that
+   * cached translation units only get reparsed when one of them changed.
    */
   class TranslationUnitCache {
   public:
     /** @brief Constructor
      *
      * @param memoryLimit The maximum memory usage (in bytes) of the cache.
+     * @param residentLimit The maximum resident memory (in bytes) of the
+     *                      process, or 0 for no limit.
      */
-    TranslationUnitCache (unsigned long memoryLimit);
+    TranslationUnitCache (unsigned long memoryLimit, unsigned long residentLimit = 0);
 
     /** @brief Determine whether a cache entry exists.
      *
@@ -32,24 +46,143 @@ namespace LibClang {
 
     /** @brief Add a new translation unit to the cache.
      *
-     * Inserts the translation unit into the cache, and possibly disposes older translation
-     * units in order to satisfy the memory usage limit.
+     * Inserts the translation unit into the cache, and possibly disposes other translation
+     * units in order to satisfy the memory usage limits.
+     *
+     * @param fileName  The source file name
+     * @param tu        The translation unit
+     * @param unsaved   The set of unsaved contents with which it was parsed
+     * @param flags     An identifier of the compilation flags with which it
+     *                  was parsed (see flags())
      */
-    void insert (const std::string & fileName, const TranslationUnit & tu);
+    void insert (const std::string & fileName, const TranslationUnit & tu,
+                 const UnsavedFiles & unsaved = UnsavedFiles(),
+                 int flags = -1);
+
+    /** @brief Get the compilation flags of a cached translation unit.
+     *
+     * Translation units sharing the same identifier were parsed with the
+     * same compilation flags. A translation unit whose identifier differs
+     * from the current one should be parsed again from scratch.
+     *
+     * Use contains() to first determine whether the cache entry exists.
+     *
+     * @return the identifier given to insert()
+     */
+    int flags (const std::string & fileName) const;
 
     /** @brief Retrieve a translation unit from the cache.
      *
-     * Use @m contains() to first determine whether the cache entry exists.
+     * This counts as a hit for the translation unit.
+     *
+     * Use contains() to first determine whether the cache entry exists.
      */
     TranslationUnit & get (const std::string & fileName);
 
+    /** @brief Bring a cached translation unit up-to-date
+     *
+     * The translation unit is reparsed, reading up-to-date source code from
+     * the file system, but only if one of its source files was modified since
+     * it was last parsed. Other translation units may then be disposed, since
+     * reparsing can change the memory usage of the translation unit.
+     *
+     * Use contains() to first determine whether the cache entry exists.
+     *
+     * @return true if the translation unit was reparsed
+     */
+    bool reparse (const std::string & fileName);
+
+    /** @brief Bring a cached translation unit up-to-date
+     *
+     * The translation unit is reparsed, reading up-to-date content from the
+     * set of in-memory buffers in @em unsaved, but only if either these
+     * buffers or one of its source files changed since it was last parsed.
+     *
+     * Use contains() to first determine whether the cache entry exists.
+     *
+     * @param fileName  The source file name
+     * @param unsaved   A set of unsaved contents for the source files
+     *
+     * @return true if the translation unit was reparsed
+     */
+    bool reparse (const std::string & fileName, UnsavedFiles & unsaved);
+
+    /** @brief Dispose a translation unit
+     *
+     * This is used when a translation unit must be parsed again from scratch,
+     * for example because its compilation command changed. Nothing happens if
+     * the cache does not contain the translation unit.
+     *
+     * @param fileName  The source file name
+     */
+    void remove (const std::string & fileName);
+
+    /** @brief Cache statistics */
+    struct Statistics {
+      unsigned long misses;     ///< number of inserted translation units
+      unsigned long reparses;   ///< number of reparsed translation units
+      unsigned long skips;      ///< number of up-to-date translation units which did not need to be reparsed
+    };
+
+    /** @brief Get the cache statistics
+     *
+     * This method can safely be called concurrently with other methods.
+     */
+    Statistics statistics () const;
+
+    /** @brief Information about a cache entry */
+    struct EntryInfo {
+      std::string   fileName;   ///< source file name
+      int           flags;      ///< identifier of the compilation flags
+      unsigned long memory;     ///< memory usage (in bytes), as of the last (re)parse
+      double        hits;       ///< number of recent hits
+      double        cost;       ///< eviction cost (entries with higher costs get evicted first)
+    };
+
+    /** @brief Get information about all cache entries
+     *
+     * @return a list of entries, sorted by decreasing eviction cost
+     */
+    std::vector<EntryInfo> entries () const;
+
+    /** @brief Get the memory usage of all cached translation units
+     *
+     * @return the total memory usage (in bytes)
+     */
+    unsigned long memoryUsage () const;
+
+    /** @brief Get the resident memory of the process
+     *
+     * @return the resident set size (in bytes)
+     */
+    static unsigned long residentMemory ();
+
   private:
+    struct Entry {
+      TranslationUnit    tu;
+      Dependencies       dependencies;
+      unsigned long long unsaved;
+      int                flags;
+      unsigned long      memory;
+      double             hits;
+      unsigned long      lastHit;
+    };
+
+    Entry & entry_ (const std::string & fileName);
+    bool reparse_ (Entry & entry, UnsavedFiles & unsaved);
+    double hits_ (const Entry & entry) const;
+    void evict_ (const std::string & keep);
+
     const unsigned long memoryLimit_;
+    const unsigned long residentLimit_;
     unsigned long memoryUsage_;
+    unsigned long time_;
+
+    std::map<std::string, Entry> tunits_;
 
-    typedef std::list<std::string> LRUFileList;
-    LRUFileList lruFiles_;
-    std::map<std::string, std::pair<TranslationUnit, LRUFileList::iterator>> tunits_;
+    std::atomic<unsigned long> misses_;
+    std::atomic<unsigned long> reparses_;
+    std::atomic<unsigned long> skips_;
   };
 
   /** @} */
@@ -1,14 +1,20 @@
 #pragma once
 
-#include <sstream>
+#include <clang-c/Index.h>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
 #include <vector>
+#include <initializer_list>
 
 namespace LibClang {
 
   /** @brief Set of in-memory buffers storing up-to-date contents for unsaved files
    *
    * This class essentially is a vector of libclang's @c CXUnsavedFile buffers.
+   * Buffer contents are shared (and never modified), so that copying a set of
+   * unsaved files does not copy their contents.
    */
   class UnsavedFiles {
   public:
@@ -23,26 +29,26 @@ namespace LibClang {
      */
     void add (const std::string sourcePath, const std::string bufferPath)
     {
-      const int bufsize = 4096;
-      char *buf = new char[bufsize];
+      std::ifstream buffer (bufferPath, std::ios::binary);
+      std::shared_ptr<std::string> contents (new std::string);
+      contents->assign (std::istreambuf_iterator<char> (buffer),
+                        std::istreambuf_iterator<char> ());
 
-      std::ostringstream contents;
-      std::ifstream buffer (bufferPath);
-      do {
-        buffer.get (buf, bufsize, 0);
-        contents << buf;
-      } while (! buffer.eof());
-
-      delete[] buf;
+      add (sourcePath, std::shared_ptr<const std::string> (contents));
+    }
 
+    /** @brief Store updated content for a source file
+     *
+     * Add an unsaved file to the list, associating it with updated contents
+     * already in memory.
+     *
+     * @param sourcePath  path to the source file
+     * @param contents    up-to-date contents
+     */
+    void add (const std::string & sourcePath, std::shared_ptr<const std::string> contents)
+    {
       sourcePath_.push_back (sourcePath);
-      contents_.push_back (contents.str());
-      unsavedFile_.resize (sourcePath_.size());
-
-      CXUnsavedFile & unsavedFile = unsavedFile_.back();
-      unsavedFile.Filename = sourcePath_.back().c_str();
-      unsavedFile.Contents = contents_.back().c_str();
-      unsavedFile.Length   = contents_.back().size();
+      contents_.push_back (contents);
     }
 
     /** @brief Get the size of the unsaved files set
@@ -53,17 +59,57 @@ namespace LibClang {
       return sourcePath_.size();
     }
 
+    /** @brief Get the path of an unsaved file
+     *
+     * @param i  index of the unsaved file, in [0, size())
+     *
+     * @return path of the source file, as given to add()
+     */
+    const std::string & sourcePath (unsigned int i) const {
+      return sourcePath_[i];
+    }
+
+    /** @brief Get a hash of the unsaved files set
+     *
+     * Two sets with the same files and contents have the same hash.
+     *
+     * @return 64-bit hash of the file names and contents
+     */
+    unsigned long long hash () const {
+      // FNV-1a, with a null character after each string
+      unsigned long long res = 14695981039346656037ULL;
+      for (unsigned int i = 0 ; i < size() ; ++i) {
+        for (const std::string * str : {&sourcePath_[i], contents_[i].get()}) {
+          for (unsigned char c : *str) {
+            res ^= c;
+            res *= 1099511628211ULL;
+          }
+          res *= 1099511628211ULL;
+        }
+      }
+      return res;
+    }
+
     /** @brief Get a C-like array of unsaved files
      *
-     * @return C pointer to the first unsaved file
+     * The array remains valid until the next modification of the set.
+     *
+     * @return C pointer to the first unsaved file (or NULL if the set is empty)
      */
     CXUnsavedFile * begin () {
-      return &(unsavedFile_[0]);
+      unsavedFile_.resize (size());
+      for (unsigned int i = 0 ; i < size() ; ++i) {
+        CXUnsavedFile & unsavedFile = unsavedFile_[i];
+        unsavedFile.Filename = sourcePath_[i].c_str();
+        unsavedFile.Contents = contents_[i]->c_str();
+        unsavedFile.Length   = contents_[i]->size();
+      }
+      return unsavedFile_.empty() ? NULL : &(unsavedFile_[0]);
     }
 
   private:
-    std::vector<std::string>   sourcePath_;
-    std::vector<std::string>   contents_;
-    std::vector<CXUnsavedFile> unsavedFile_;
+    std::vector<std::string>                        sourcePath_;
+    std::vector<std::shared_ptr<const std::string>> contents_;
+    std::vector<CXUnsavedFile>                      unsavedFile_;
   };
 }
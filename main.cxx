@@ -2,7 +2,7 @@
 #include "util/util.hxx"
 #include "request/request.hxx"
 #include "getopt++/getopt.hxx"
-#include <boost/asio.hpp>
+#include "server.hxx"
 
 class CompilationDatabaseCommand : public Request::CommandParser {
 public:
@@ -17,10 +17,14 @@ public:
     add (key ("database", args_.fileName)
          ->metavar ("FILEPATH")
          ->description ("Load compilation commands from a JSON compilation database"));
+    add (key ("merge", args_.merge)
+         ->metavar ("true|false")
+         ->description ("Keep the commands of files which are not in the database"));
   }
 
   void defaults () {
     args_.fileName = "compile_commands.json";
+    args_.merge = false;
   }
 
   void run (std::ostream & cout) {
@@ -46,10 +50,15 @@ public:
     add (key ("diagnostics", args_.diagnostics)
          ->metavar ("true|false")
          ->description ("Print compilation diagnostics"));
+    add (key ("jobs", args_.jobs)
+         ->metavar ("N")
+         ->description ("Number of parallel indexing jobs (0: server default)"));
   }
 
   void defaults () {
     args_.diagnostics = true;
+    args_.jobs = 0;
+    args_.deferIndexes = false;
   }
 
   void run (std::ostream & cout) {
@@ -75,11 +84,19 @@ public:
     add (key ("exclude", args_.exclude)
          ->metavar ("PATH")
          ->description ("Exclude path"));
+    add (key ("deferIndexes", args_.deferIndexes)
+         ->metavar ("true|false")
+         ->description ("Build database indexes after all files have been indexed"));
+    add (key ("engine", args_.engine)
+         ->metavar ("visitor|callbacks")
+         ->description ("Indexing engine: traverse whole ASTs, or use libclang's indexing callbacks"));
   }
 
   void defaults () {
     UpdateCommand::defaults();
     args_.exclude = {"/usr"};
+    args_.deferIndexes = true;
+    args_.engine = "visitor";
   }
 
   void run (std::ostream & cout) {
@@ -162,6 +179,54 @@ private:
 };
 
 
+class BufferCommand : public Request::CommandParser {
+public:
+  BufferCommand (const std::string & name, Application & application)
+    : Request::CommandParser (name, "Update the contents of an unsaved buffer"),
+      application_ (application)
+  {
+    prompt_ = "buffer> ";
+    defaults();
+
+    using Request::key;
+    add (key ("file", args_.fileName)
+         ->metavar ("FILENAME")
+         ->description ("Source file name"));
+    add (key ("contents", args_.contents)
+         ->metavar ("TEXT")
+         ->description ("Whole buffer contents (if no offsets are given)"));
+    add (key ("offset1", args_.offset1)
+         ->metavar ("OFFSET")
+         ->description ("Beginning of the edited range (in bytes)"));
+    add (key ("offset2", args_.offset2)
+         ->metavar ("OFFSET")
+         ->description ("End of the edited range (in bytes)"));
+    add (key ("text", args_.text)
+         ->metavar ("TEXT")
+         ->description ("Replacement text for the edited range"));
+    add (key ("close", args_.close)
+         ->metavar ("BOOL")
+         ->description ("Forget the buffer, and use the file contents again"));
+  }
+
+  void defaults () {
+    args_.fileName = "";
+    args_.contents = "";
+    args_.offset1 = -1;
+    args_.offset2 = -1;
+    args_.text = "";
+    args_.close = false;
+  }
+
+  void run (std::ostream & cout) {
+    application_.buffer (args_, cout);
+  }
+
+private:
+  Application & application_;
+  Application::BufferArgs args_;
+};
+
 class CompleteCommand : public Request::CommandParser {
 public:
   CompleteCommand (const std::string & name, Application & application)
@@ -181,12 +246,20 @@ public:
     add (key ("column", args_.column)
          ->metavar ("COLUMN_NO")
          ->description ("Column number (counting from 0)"));
+    add (key ("prefix", args_.prefix)
+         ->metavar ("TEXT")
+         ->description ("Text typed since the completion point, used to filter candidates"));
+    add (key ("limit", args_.limit)
+         ->metavar ("N")
+         ->description ("Maximum number of candidates (0 for no limit)"));
   }
 
   void defaults () {
     args_.fileName = "";
     args_.line = 0;
     args_.column = 0;
+    args_.prefix = "";
+    args_.limit = 0;
   }
 
   void run (std::ostream & cout) {
@@ -198,6 +271,38 @@ private:
   Application::CompleteArgs args_;
 };
 
+struct StatsCommand : public Request::CommandParser {
+  StatsCommand (const std::string & name, Application & application)
+    : Request::CommandParser (name, "Report memory usage of the translation unit cache"),
+      application_ (application)
+  {
+    prompt_ = "stats> ";
+  }
+
+  void run (std::ostream & cout) {
+    application_.stats (cout);
+  }
+
+private:
+  Application & application_;
+};
+
+struct StatusCommand : public Request::CommandParser {
+  StatusCommand (const std::string & name, Application & application)
+    : Request::CommandParser (name, "Report how up-to-date the index is"),
+      application_ (application)
+  {
+    prompt_ = "status> ";
+  }
+
+  void run (std::ostream & cout) {
+    application_.status (cout);
+  }
+
+private:
+  Application & application_;
+};
+
 struct ExitCommand : public Request::CommandParser {
   ExitCommand (const std::string & name)
     : Request::CommandParser (name, "Shutdown server")
@@ -212,6 +317,25 @@ struct ExitCommand : public Request::CommandParser {
 };
 
 
+// Commands store the arguments of the request being handled: concurrent
+// requests need separate parsers
+Request::Parser * requestParser (Application & app) {
+  Request::Parser * p = new Request::Parser ("Clang-tags server\n");
+  p->add (new CompilationDatabaseCommand ("load", app))
+    .add (new IndexCommand ("index", app))
+    .add (new UpdateCommand ("update", app))
+    .add (new FindCommand ("find", app))
+    .add (new GrepCommand ("grep", app))
+    .add (new BufferCommand ("buffer", app))
+    .add (new CompleteCommand ("complete", app))
+    .add (new StatusCommand ("status", app))
+    .add (new StatsCommand ("stats", app))
+    .add (new ExitCommand ("exit"))
+    .prompt ("clang-dde> ");
+  return p;
+}
+
+
 int main (int argc, char **argv) {
   Getopt options (argc, argv);
   options.add ("help", 'h', 0,
@@ -220,6 +344,21 @@ int main (int argc, char **argv) {
                "read a request from the standard input and exit");
   options.add ("cachesize", 'l', 1,
                "specify the maximum size of the translation unit cache (in MB)");
+  options.add ("memory", 'm', 1,
+               "specify the maximum resident memory of the server (in MB, 0 for no limit);"
+               " cached translation units are disposed to stay below it");
+  options.add ("astcache", 'a', 1,
+               "specify the maximum size of the on-disk AST cache (in MB, 0 to disable)");
+  options.add ("jobs", 'j', 1,
+               "specify the default number of parallel indexing jobs");
+  options.add ("skip-bodies", 'b', 0,
+               "skip function bodies when indexing (faster, but references"
+               " inside functions are not indexed)");
+  options.add ("threads", 't', 1,
+               "specify the number of threads handling requests");
+  options.add ("debounce", 'd', 1,
+               "specify the delay (in ms) before modified files get re-indexed"
+               " in the background (0 to disable)");
 
   try {
     options.get();
@@ -247,21 +386,76 @@ int main (int argc, char **argv) {
   // Convert to bytes from MB.
   cacheLimit *= 1024 * 1024;
 
-  Storage storage;
-  Application app (storage, cacheLimit);
-  Request::Parser p ("Clang-tags server\n");
-  p .add (new CompilationDatabaseCommand ("load", app))
-    .add (new IndexCommand ("index", app))
-    .add (new UpdateCommand ("update", app))
-    .add (new FindCommand ("find", app))
-    .add (new GrepCommand ("grep", app))
-    .add (new CompleteCommand ("complete", app))
-    .add (new ExitCommand ("exit"))
-    .prompt ("clang-dde> ");
+  // Default to no limit on the resident memory.
+  unsigned long residentLimit = 0;
+  if (options.getCount ("memory") > 0) {
+    try {
+      residentLimit = std::stoul(options["memory"]);
+    } catch (...) {
+      std::cerr << "Invalid memory value: " << options["memory"] << std::endl;
+      return 1;
+    }
+  }
+  residentLimit *= 1024 * 1024;
+
+  // Default to an on-disk AST cache of 1GB.
+  unsigned long astCacheLimit = 1024;
+  if (options.getCount ("astcache") > 0) {
+    try {
+      astCacheLimit = std::stoul(options["astcache"]);
+    } catch (...) {
+      std::cerr << "Invalid astcache value: " << options["astcache"] << std::endl;
+      return 1;
+    }
+  }
+  astCacheLimit *= 1024 * 1024;
 
+  // Default to sequential indexing.
+  unsigned long jobs = 1;
+  if (options.getCount ("jobs") > 0) {
+    try {
+      jobs = std::stoul(options["jobs"]);
+    } catch (...) {
+      jobs = 0;
+    }
+    if (jobs == 0) {
+      std::cerr << "Invalid jobs value: " << options["jobs"] << std::endl;
+      return 1;
+    }
+  }
+
+  // Default to handling 4 requests concurrently.
+  unsigned long threads = 4;
+  if (options.getCount ("threads") > 0) {
+    try {
+      threads = std::stoul(options["threads"]);
+    } catch (...) {
+      threads = 0;
+    }
+    if (threads == 0) {
+      std::cerr << "Invalid threads value: " << options["threads"] << std::endl;
+      return 1;
+    }
+  }
+
+  // Default to re-indexing 1s after the last modification.
+  unsigned long debounce = 1000;
+  if (options.getCount ("debounce") > 0) {
+    try {
+      debounce = std::stoul(options["debounce"]);
+    } catch (...) {
+      std::cerr << "Invalid debounce value: " << options["debounce"] << std::endl;
+      return 1;
+    }
+  }
+
+  Storage storage;
+  Application app (storage, cacheLimit, residentLimit, astCacheLimit, jobs,
+                   options.getCount ("skip-bodies") > 0);
 
   if (options.getCount ("stdin") > 0) {
-    p.parseJson (std::cin, std::cout);
+    std::unique_ptr<Request::Parser> p (requestParser (app));
+    p->parseJson (std::cin, std::cout);
   }
   else {
     const std::string pidPath (".ct.pid");
@@ -271,21 +465,24 @@ int main (int argc, char **argv) {
 
     std::cerr << "Server starting with pid: " << getpid() << std::endl;
 
+    if (debounce > 0) {
+      try {
+        app.watch (debounce);
+      } catch (std::exception & e) {
+        std::cerr << "Warning: " << e.what() << std::endl
+                  << "  modified files will not be re-indexed in the background" << std::endl;
+      }
+    }
+
     const std::string socketPath (".ct.sock");
     try
       {
-        boost::asio::io_service io_service;
-        boost::asio::local::stream_protocol::endpoint endpoint (socketPath);
-        boost::asio::local::stream_protocol::acceptor acceptor (io_service, endpoint);
-        for (;;)
-          {
-            boost::asio::local::stream_protocol::iostream socket;
-            boost::system::error_code err;
-            acceptor.accept(*socket.rdbuf(), err);
-            if (!err) {
-              p.parseJson (socket, socket, /*verbose=*/true);
-            }
-          }
+        Server server (socketPath, threads,
+                       [&app](const Json::Value & request, std::ostream & cout) {
+                         std::unique_ptr<Request::Parser> p (requestParser (app));
+                         p->parseJson (request, cout);
+                       });
+        server.run();
       }
     catch (std::exception& e)
       {
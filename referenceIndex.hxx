@@ -0,0 +1,246 @@
+#pragma once
+
+#include "storage.hxx"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// In-memory index of the references found in each file, used to answer
+// "what's at point" queries without scanning the tags table.
+//
+// Files are loaded lazily from the database, and forgotten whenever they are
+// re-indexed. Definitions are cached by USR; since they may come from any
+// file, they are all forgotten whenever the index is updated.
+class ReferenceIndex {
+public:
+  ReferenceIndex ()
+    : generation_ (0)
+  { }
+
+  // References containing an offset, from the most specific (smallest extent)
+  // to the least specific one, along with their definitions.
+  //
+  // The storage must not have been read yet in the current transaction (see
+  // loadFile_()).
+  std::vector<Storage::RefDef> findDefinition (Storage & storage,
+                                               const std::string & fileName,
+                                               int offset) {
+    unsigned long generation;
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      generation = generation_;
+    }
+
+    std::shared_ptr<const File> file = loadFile_ (storage, fileName, generation);
+
+    std::vector<const Storage::FileReference *> refs;
+    file->find (offset, refs);
+
+    std::vector<Storage::RefDef> ret;
+    for (const auto ref : refs) {
+      std::shared_ptr<const Definitions> defs = loadDefinitions_ (storage, ref->usrId, generation);
+      if (defs->empty()) {
+        continue;
+      }
+
+      Storage::RefDef refDef;
+      Storage::Reference & reference = refDef.ref;
+      reference.file     = fileName;
+      reference.line1    = ref->line1;
+      reference.line2    = ref->line2;
+      reference.col1     = ref->col1;
+      reference.col2     = ref->col2;
+      reference.offset1  = ref->offset1;
+      reference.offset2  = ref->offset2;
+      reference.kind     = storage.kind (ref->kindId);
+      reference.spelling = storage.spelling (ref->spellingId);
+      for (const auto & def : *defs) {
+        refDef.def = def;
+        ret.push_back (refDef);
+      }
+    }
+    return ret;
+  }
+
+  // Forget the given files (after their tags have been modified in the
+  // database) and all cached definitions
+  void invalidate (const std::set<std::string> & fileNames) {
+    std::lock_guard<std::mutex> lock (mutex_);
+    ++generation_;
+    for (const auto & fileName : fileNames) {
+      files_.erase (fileName);
+    }
+    definitions_.clear();
+  }
+
+  // Forget everything (e.g. when the whole index is rebuilt)
+  void clear () {
+    std::lock_guard<std::mutex> lock (mutex_);
+    ++generation_;
+    files_.clear();
+    definitions_.clear();
+  }
+
+  // References of a file, indexed by a centered interval tree.
+  //
+  // Each node holds the references containing its center offset, sorted both
+  // by start and by end offset; references entirely before (resp. after) the
+  // center go to the left (resp. right) subtree. Finding the references
+  // containing an offset thus takes O(log n + k) operations, even in the
+  // presence of file-spanning references (namespaces, classes...).
+  class File {
+  public:
+    File (std::vector<Storage::FileReference> && refs)
+      : refs_ (std::move (refs))
+    {
+      std::vector<size_t> indices (refs_.size());
+      for (size_t i = 0 ; i < indices.size() ; ++i) {
+        indices[i] = i;
+      }
+      root_ = build_ (indices);
+    }
+
+    // References containing `offset`, from the most specific (smallest
+    // extent) to the least specific one. References of the same extent are
+    // sorted by decreasing start offset.
+    void find (int offset, std::vector<const Storage::FileReference *> & ret) const {
+      std::vector<size_t> found;
+      for (int n = root_ ; n >= 0 ; ) {
+        const Node & node = nodes_[n];
+        if (offset < node.center) {
+          for (size_t i : node.byStart) {
+            if (refs_[i].offset1 > offset) break;
+            found.push_back (i);
+          }
+          n = node.left;
+        } else {
+          for (size_t i : node.byEnd) {
+            if (refs_[i].offset2 < offset) break;
+            found.push_back (i);
+          }
+          n = (offset == node.center) ? -1 : node.right;
+        }
+      }
+
+      std::sort (found.begin(), found.end(), [this](size_t a, size_t b) {
+          const int sizeA = refs_[a].offset2 - refs_[a].offset1;
+          const int sizeB = refs_[b].offset2 - refs_[b].offset1;
+          return sizeA < sizeB || (sizeA == sizeB && a > b);
+        });
+      for (size_t i : found) {
+        ret.push_back (&refs_[i]);
+      }
+    }
+
+  private:
+    struct Node {
+      int center;
+      std::vector<size_t> byStart;  // by increasing start offset
+      std::vector<size_t> byEnd;    // by decreasing end offset
+      int left;
+      int right;
+    };
+
+    // Build the subtree holding the given references, and return its index
+    // in nodes_ (or -1 if there are none)
+    int build_ (const std::vector<size_t> & indices) {
+      if (indices.empty()) {
+        return -1;
+      }
+
+      // Center on the median start offset, so that at least one reference
+      // is stored in each node
+      std::vector<int> starts;
+      starts.reserve (indices.size());
+      for (size_t i : indices) {
+        starts.push_back (refs_[i].offset1);
+      }
+      std::nth_element (starts.begin(), starts.begin() + starts.size() / 2, starts.end());
+      const int center = starts[starts.size() / 2];
+
+      Node node;
+      node.center = center;
+      std::vector<size_t> left, right;
+      for (size_t i : indices) {
+        const Storage::FileReference & ref = refs_[i];
+        if (ref.offset2 < center) {
+          left.push_back (i);
+        } else if (ref.offset1 > center) {
+          right.push_back (i);
+        } else {
+          node.byStart.push_back (i);
+        }
+      }
+      node.byEnd = node.byStart;
+      std::sort (node.byStart.begin(), node.byStart.end(), [this](size_t a, size_t b) {
+          return refs_[a].offset1 < refs_[b].offset1;
+        });
+      std::sort (node.byEnd.begin(), node.byEnd.end(), [this](size_t a, size_t b) {
+          return refs_[a].offset2 > refs_[b].offset2;
+        });
+
+      node.left  = build_ (left);
+      node.right = build_ (right);
+      nodes_.push_back (std::move (node));
+      return nodes_.size() - 1;
+    }
+
+    std::vector<Storage::FileReference> refs_;
+    std::vector<Node>                   nodes_;
+    int                                 root_;
+  };
+
+private:
+  typedef std::vector<Storage::Definition> Definitions;
+
+  // Database queries are run without holding the lock. Their results are
+  // only kept if the index was not invalidated since `generation` was read:
+  // the transaction might otherwise see the database as it was before the
+  // update.
+  std::shared_ptr<const File> loadFile_ (Storage & storage, const std::string & fileName,
+                                         unsigned long generation) {
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      auto it = files_.find (fileName);
+      if (it != files_.end()) {
+        return it->second;
+      }
+    }
+
+    std::shared_ptr<const File> file (new File (storage.fileReferences (fileName)));
+
+    std::lock_guard<std::mutex> lock (mutex_);
+    if (generation == generation_) {
+      files_[fileName] = file;
+    }
+    return file;
+  }
+
+  std::shared_ptr<const Definitions> loadDefinitions_ (Storage & storage, int usrId,
+                                                       unsigned long generation) {
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      auto it = definitions_.find (usrId);
+      if (it != definitions_.end()) {
+        return it->second;
+      }
+    }
+
+    std::shared_ptr<const Definitions> defs (new Definitions (storage.definitions (usrId)));
+
+    std::lock_guard<std::mutex> lock (mutex_);
+    if (generation == generation_) {
+      definitions_[usrId] = defs;
+    }
+    return defs;
+  }
+
+  std::mutex mutex_;
+  unsigned long generation_;
+  std::map<std::string, std::shared_ptr<const File>> files_;
+  std::map<int, std::shared_ptr<const Definitions>>  definitions_;
+};
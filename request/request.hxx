@@ -250,6 +250,11 @@ namespace Request {
     iss >> std::boolalpha >> destination;
   }
 
+  // Strings are taken as a whole (including whitespace)
+  inline void setValue (const Json::Value & json, std::string & destination) {
+    destination = json.asString();
+  }
+
   /** @brief Scalar key parser
    *
    * Parses a key and stores a single value in a destination variable.
@@ -709,16 +714,29 @@ namespace Request {
         std::cerr << "Processing request... ";
       cout << "Server response:" << std::endl << std::flush;
 
-      std::string command = json["command"].asString();
+      parseJson (json, cout);
+
+      if (verbose)
+        std::cerr << "done." << std::endl << std::endl;
+    }
+
+    /** @brief Run the command associated to an already parsed JSON request
+     *
+     * Unlike parseJson(std::istream&,std::ostream&,bool), this does not read
+     * the request nor output any header before the results. This is used when
+     * requests are framed by another protocol.
+     *
+     * @param request  JSON request
+     * @param cout     output stream where results are printed
+     */
+    void parseJson (const Json::Value & request, std::ostream & cout) {
+      std::string command = request["command"].asString();
       CommandMap::const_iterator it = commands_.find (command);
       if (it != commands_.end()) {
-        it->second->parseJson (json, cout);
+        it->second->parseJson (request, cout);
       } else {
         cout << "Unknown command: `" << command << "'" << std::endl;
       }
-
-      if (verbose)
-        std::cerr << "done." << std::endl << std::endl;
     }
 
   private:
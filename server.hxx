@@ -0,0 +1,272 @@
+#pragma once
+
+#include "json/json.h"
+
+#include <boost/asio.hpp>
+#include <sys/socket.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// Asynchronous server listening on a UNIX socket
+//
+// Connections are accepted asynchronously, and handled by a pool of worker
+// threads: a long-running request (such as `index`) only keeps one worker
+// busy while other requests get handled. Requests are read from the socket
+// by a dedicated thread per connection, and only handed to the pool once
+// they are complete: idle or slow clients never keep a worker busy.
+//
+// Two protocols are understood, depending on the first line sent by the
+// client:
+//
+// - one-shot connections carry a single JSON request, terminated by a blank
+//   line. The response is written as it is produced, after a "Server
+//   response:" header line, and the connection is closed afterwards.
+//
+// - persistent connections start with a JSON request written on a single line
+//   and holding an "id" member. The connection then carries any number of
+//   such newline-delimited requests. Requests are handled concurrently, and
+//   each response is written, as soon as it is complete, as a single line:
+//     {"id": <request id>, "output": <request output>}
+//   Responses may thus come in a different order than requests.
+//
+// An exception escaping the handler stops the server.
+class Server {
+public:
+  typedef boost::asio::local::stream_protocol Protocol;
+  typedef std::function<void (const Json::Value &, std::ostream &)> Handler;
+
+  Server (const std::string & socketPath, unsigned int threads, Handler handler)
+    : acceptor_ (ioService_, Protocol::endpoint (socketPath)),
+      threads_ (threads),
+      handler_ (handler),
+      readers_ (0)
+  { }
+
+  // Serve requests until an exception is raised by the handler
+  void run () {
+    accept_ ();
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1 ; i < threads_ ; ++i) {
+      workers.push_back (std::thread ([this](){ ioService_.run(); }));
+    }
+    ioService_.run();
+    for (auto & worker : workers) {
+      worker.join();
+    }
+
+    // Wake up threads reading connections, and wait for them
+    std::unique_lock<std::mutex> lock (connectionsMutex_);
+    for (auto & connection : connections_) {
+      shutdown (connection->socket(), SHUT_RDWR);
+    }
+    readersDone_.wait (lock, [this]{ return readers_ == 0; });
+  }
+
+private:
+  typedef std::shared_ptr<Protocol::iostream> Stream;
+
+  // Client connection
+  //
+  // Requests are read by a dedicated thread, so that idle connections don't
+  // keep workers busy. Responses to one-shot requests are streamed to
+  // output(); responses on persistent connections are written directly to the
+  // socket by the workers, independently of the input stream.
+  class Connection {
+  public:
+    Connection (Stream stream)
+      : stream_ (stream)
+    { }
+
+    std::istream & input () {
+      return *stream_;
+    }
+
+    std::ostream & output () {
+      return *stream_;
+    }
+
+    int socket () {
+      return stream_->rdbuf()->socket().native_handle();
+    }
+
+    void write (const std::string & data) {
+      std::lock_guard<std::mutex> lock (writeMutex_);
+      const char * it  = data.data();
+      const char * end = it + data.size();
+      while (it < end) {
+        const ssize_t n = send (socket(), it, end - it, MSG_NOSIGNAL);
+        if (n <= 0) {
+          return;  // The client went away
+        }
+        it += n;
+      }
+    }
+
+  private:
+    Stream     stream_;
+    std::mutex writeMutex_;
+  };
+
+  void accept_ () {
+    Stream stream (new Protocol::iostream);
+    acceptor_.async_accept (*stream->rdbuf(),
+                            [this, stream](const boost::system::error_code & err) {
+                              handle_ (stream, err);
+                            });
+  }
+
+  void handle_ (Stream stream, const boost::system::error_code & err) {
+    // Keep accepting connections while this one is being handled
+    accept_ ();
+
+    if (err) {
+      return;
+    }
+
+    std::shared_ptr<Connection> connection (new Connection (stream));
+    std::lock_guard<std::mutex> lock (connectionsMutex_);
+    connections_.insert (connection);
+    ++readers_;
+    std::thread (&Server::read_, this, connection).detach();
+  }
+
+  // Read requests from a connection, until the client closes it or a one-shot
+  // request has been read
+  void read_ (std::shared_ptr<Connection> connection) {
+    std::string line;
+    std::getline (connection->input(), line);
+
+    Json::Value request;
+    if (Json::Reader().parse (line, request, false)
+        && request.isObject() && request.isMember ("id")) {
+      readPersistent_ (connection, request);
+    } else {
+      readOneShot_ (connection, line);
+    }
+
+    std::lock_guard<std::mutex> lock (connectionsMutex_);
+    connections_.erase (connection);
+    --readers_;
+    readersDone_.notify_all();
+  }
+
+  // One-shot request: read until the first blank line
+  void readOneShot_ (std::shared_ptr<Connection> connection, std::string line) {
+    std::string text;
+    while (line != "") {
+      text += line + "\n";
+      if (!std::getline (connection->input(), line)) {
+        break;
+      }
+    }
+    if (text == "") {
+      return;  // Nothing to handle
+    }
+
+    ioService_.post ([this, connection, text]() {
+        respondOneShot_ (connection, text);
+      });
+  }
+
+  void respondOneShot_ (std::shared_ptr<Connection> connection, const std::string & text) {
+    std::cerr << "Receiving client request:" << std::endl
+              << text
+              << "Processing request... ";
+    std::ostream & output = connection->output();
+    output << "Server response:" << std::endl << std::flush;
+
+    Json::Reader reader;
+    Json::Value request;
+    std::string error;
+    if (!reader.parse (text, request, false)) {
+      error = reader.getFormattedErrorMessages();
+    } else if (!request.isObject()) {
+      error = "expected a JSON object\n";
+    }
+    if (error != "") {
+      output << "Invalid request: " << error << std::flush;
+      std::cerr << "invalid." << std::endl << std::endl;
+      return;
+    }
+
+    try {
+      handler_ (request, output);
+    } catch (std::exception & e) {
+      output << std::flush;
+      std::cerr << std::endl << "Caught exception: " << e.what() << std::endl;
+      ioService_.stop();
+      return;
+    }
+    output << std::flush;
+    std::cerr << "done." << std::endl << std::endl;
+  }
+
+  // Persistent connection: read newline-delimited requests
+  void readPersistent_ (std::shared_ptr<Connection> connection, const Json::Value & first) {
+    dispatch_ (connection, first);
+
+    std::string line;
+    while (std::getline (connection->input(), line)) {
+      if (line == "") {
+        continue;
+      }
+
+      Json::Value request;
+      if (Json::Reader().parse (line, request, false) && request.isObject()) {
+        dispatch_ (connection, request);
+      } else {
+        Json::Value response;
+        response["id"]    = Json::nullValue;
+        response["error"] = "Invalid request: " + line;
+        connection->write (Json::FastWriter().write (response));
+      }
+    }
+  }
+
+  void dispatch_ (std::shared_ptr<Connection> connection, const Json::Value & request) {
+    ioService_.post ([this, connection, request]() {
+        respond_ (connection, request);
+      });
+  }
+
+  void respond_ (std::shared_ptr<Connection> connection, const Json::Value & request) {
+    std::cerr << "Processing request " << Json::FastWriter().write (request["id"]);
+
+    std::ostringstream output;
+    bool stop = false;
+    try {
+      handler_ (request, output);
+    } catch (std::exception & e) {
+      std::cerr << "Caught exception: " << e.what() << std::endl;
+      stop = true;
+    }
+
+    Json::Value response;
+    response["id"]     = request["id"];
+    response["output"] = output.str();
+    connection->write (Json::FastWriter().write (response));
+
+    if (stop) {
+      ioService_.stop();
+    }
+  }
+
+  boost::asio::io_service  ioService_;
+  Protocol::acceptor       acceptor_;
+  const unsigned int       threads_;
+  Handler                  handler_;
+
+  // Open connections, and number of threads reading them
+  std::mutex                            connectionsMutex_;
+  std::condition_variable               readersDone_;
+  std::set<std::shared_ptr<Connection>> connections_;
+  unsigned int                          readers_;
+};
@@ -1,57 +1,200 @@
 #pragma once
 
-#include <fstream>
-#include <sstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-class SourceFile : public std::ifstream {
+// Contents of a source file, read in memory
+//
+// Files are read (rather than mapped) into an owned buffer, so that a file
+// being truncated while it is used can't crash the server.
+//
+// Lines are located using a table of line offsets, built the first time a
+// line is requested. Unreadable files behave as empty files.
+class SourceFile {
 public:
   SourceFile (const std::string & fileName)
-    : std::ifstream (fileName.c_str())
-  { }
-
-  std::string substring (const unsigned int offset1, const unsigned int offset2) {
-    unsigned int len = offset2 - offset1;
-    char * buffer = new char [len+1];
+    : modified_ (-1)
+  {
+    const int fd = open (fileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return;
+    }
 
-    seekg (offset1);
-    read (buffer, len);
-    buffer[len] = 0;
+    struct stat fileStat;
+    if (fstat (fd, &fileStat) == 0) {
+      modified_ = timestamp_ (fileStat);
+      data_.resize (fileStat.st_size);
 
-    std::string res (buffer);
-    delete[] buffer;
+      // Stop early if the file gets truncated while it is being read: the
+      // size won't match in upToDate(), and the file will be read again
+      size_t size = 0;
+      while (size < data_.size()) {
+        const ssize_t n = pread (fd, &data_[size], data_.size() - size, size);
+        if (n == -1 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          break;
+        }
+        size += n;
+      }
+      data_.resize (size);
+    }
+    close (fd);
+  }
 
-    return shorten_ (res, 42);
+  // Text in [offset1, offset2), with whitespace collapsed and shortened to
+  // about 42 characters
+  std::string substring (const unsigned int offset1, const unsigned int offset2) const {
+    const size_t end   = std::min<size_t> (offset2, data_.size());
+    const size_t begin = std::min<size_t> (offset1, end);
+    return shorten_ (data_.data() + begin, data_.data() + end, 42);
   }
 
-  std::string line (const unsigned int lineno) {
-    seekg (0);
-    std::string line;
-    for (unsigned int i=0 ; i<lineno ; ++i) {
-      std::getline (*this, line);
+  // Contents of a line (counted from 1), without its end-of-line character
+  std::string line (const unsigned int lineno) const {
+    std::call_once (linesFlag_, [this]{ indexLines_(); });
+
+    if (lineno == 0 || lineno > lines_.size()) {
+      return "";
+    }
+    const size_t begin = lines_[lineno-1];
+    size_t end = lineno < lines_.size() ? lines_[lineno] : data_.size();
+    if (end > begin && data_[end-1] == '\n') {
+      --end;
     }
+    return data_.substr (begin, end - begin);
+  }
 
-    return line;
+  // Determine whether the file changed since it was read
+  bool upToDate (const std::string & fileName) const {
+    struct stat fileStat;
+    if (stat (fileName.c_str(), &fileStat) != 0) {
+      return modified_ == -1;
+    }
+    return timestamp_ (fileStat) == modified_
+      && (size_t)fileStat.st_size == data_.size();
   }
 
 private:
-  static std::string shorten_ (const std::string & s, const unsigned int sizeMax) {
-    std::istringstream iss (s);
-
-    std::string word;
-    iss >> word;
-    std::string res = word;
-    while (! iss.eof()) {
-      iss >> word;
-      res += " " + word;
-
-      if (res.size() > sizeMax) {
-        res = res.substr(0, sizeMax-3);
-        res += "...";
+  static long long timestamp_ (const struct stat & fileStat) {
+    return fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+  }
+
+  // Offsets of line beginnings. memchr is vectorized in the C library, which
+  // makes this scan much faster than reading lines one character at a time.
+  void indexLines_ () const {
+    const char * const begin = data_.data();
+    const char * const end   = begin + data_.size();
+    const char * it = begin;
+    while (it < end) {
+      lines_.push_back (it - begin);
+      const char * eol = static_cast<const char *> (memchr (it, '\n', end - it));
+      if (!eol) {
         break;
       }
+      it = eol + 1;
     }
+  }
 
+  static std::string shorten_ (const char * begin, const char * end,
+                               const unsigned int sizeMax) {
+    // Words separated by single spaces
+    std::string res;
+    bool space = false;
+    for (const char * it = begin ; it != end ; ++it) {
+      if (std::isspace ((unsigned char)*it)) {
+        space = !res.empty();
+        continue;
+      }
+      if (space) {
+        res += ' ';
+        space = false;
+      }
+      res += *it;
+    }
+
+    // A single word is never shortened
+    if (res.size() > sizeMax && res.find (' ') != std::string::npos) {
+      res = res.substr (0, sizeMax-3);
+      res += "...";
+    }
     return res;
   }
 
+  std::string                 data_;
+  long long                   modified_;   // in nanoseconds, or -1 if unreadable
+  mutable std::once_flag      linesFlag_;
+  mutable std::vector<size_t> lines_;
+};
+
+
+// Source files shared between requests
+//
+// Files are read once per version: an entry is reused as long as the file
+// modification time and size did not change. Since this is checked each time
+// a file is requested, a request should get each file once and use it for all
+// its results.
+class SourceFiles {
+public:
+  SourceFiles (unsigned int maxFiles = 256)
+    : maxFiles_ (maxFiles),
+      clock_ (0)
+  { }
+
+  std::shared_ptr<const SourceFile> get (const std::string & fileName) {
+    std::shared_ptr<const SourceFile> file;
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      auto it = files_.find (fileName);
+      if (it != files_.end()) {
+        it->second.lastUse = ++clock_;
+        file = it->second.file;
+      }
+    }
+    if (file && file->upToDate (fileName)) {
+      return file;
+    }
+
+    file.reset (new SourceFile (fileName));
+
+    std::lock_guard<std::mutex> lock (mutex_);
+    Entry & entry = files_[fileName];
+    entry.file    = file;
+    entry.lastUse = ++clock_;
+
+    // Forget the least recently used file
+    if (files_.size() > maxFiles_) {
+      auto oldest = files_.begin();
+      for (auto it = files_.begin() ; it != files_.end() ; ++it) {
+        if (it->second.lastUse < oldest->second.lastUse) {
+          oldest = it;
+        }
+      }
+      files_.erase (oldest);
+    }
+
+    return file;
+  }
+
+private:
+  struct Entry {
+    std::shared_ptr<const SourceFile> file;
+    unsigned long                     lastUse;
+  };
+
+  const unsigned int            maxFiles_;
+  unsigned long                 clock_;
+  std::map<std::string, Entry>  files_;
+  std::mutex                    mutex_;
 };
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <memory>
+#include <map>
 #include <sqlite3.h>
 #include <stdexcept>
 
@@ -60,6 +61,13 @@ namespace Sqlite {
      * Get a prepared Statement object, which can then be executed with bound
      * values.
      *
+     * Prepared statements are cached, keyed by their SQL text: once a
+     * Statement object is destroyed, its compiled form is reset and kept for
+     * subsequent calls to prepare() with the same SQL code.
+     *
+     * Example use:
+     * @snippet test_sqlite++.cxx cache
+     *
      * @param sql  C-style string containing SQL statements
      *
      * @return a prepared Statement object for the SQL code
@@ -82,13 +90,59 @@ namespace Sqlite {
       return sqlite3_last_insert_rowid (raw());
     }
 
+    /** @brief Get the number of prepared statement cache hits
+     *
+     * @return the number of calls to prepare() which reused a cached statement
+     */
+    unsigned long cacheHits () const {
+      return db_->hits_;
+    }
+
+    /** @brief Get the number of prepared statement cache misses
+     *
+     * @return the number of calls to prepare() which compiled a new statement
+     */
+    unsigned long cacheMisses () const {
+      return db_->misses_;
+    }
+
   private:
     sqlite3 * raw () { return db_->db_; }
 
     struct Sqlite3_ {
       sqlite3 *db_;
-      Sqlite3_ (sqlite3 *db) : db_ (db) {}
-      ~Sqlite3_ () { sqlite3_close (db_); }
+      std::multimap<std::string, sqlite3_stmt*> cache_;
+      unsigned long hits_;
+      unsigned long misses_;
+
+      Sqlite3_ (sqlite3 *db) : db_ (db), hits_ (0), misses_ (0) {}
+      ~Sqlite3_ () {
+        for (auto it = cache_.begin() ; it != cache_.end() ; ++it) {
+          sqlite3_finalize (it->second);
+        }
+        sqlite3_close (db_);
+      }
+
+      // Get a compiled statement, either from the cache or freshly prepared
+      int acquire (const std::string & sql, sqlite3_stmt ** stmt) {
+        auto it = cache_.find (sql);
+        if (it != cache_.end()) {
+          ++hits_;
+          *stmt = it->second;
+          cache_.erase (it);
+          return SQLITE_OK;
+        }
+
+        ++misses_;
+        return sqlite3_prepare_v2 (db_, sql.c_str(), -1, stmt, NULL);
+      }
+
+      // Give a compiled statement back to the cache
+      void release (const std::string & sql, sqlite3_stmt * stmt) {
+        sqlite3_reset (stmt);
+        sqlite3_clear_bindings (stmt);
+        cache_.insert (std::make_pair (sql, stmt));
+      }
     };
     std::shared_ptr<Sqlite3_> db_;
 
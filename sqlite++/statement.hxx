@@ -32,11 +32,10 @@ namespace Sqlite {
     Statement (Sqlite::Database & db, char const *const sql)
       : db_ (db),
         bindI_ (1),
-        colI_ (0)
+        colI_ (0),
+        stmt_ (new Statement_ (db.db_, sql))
     {
-      sqlite3_stmt *stmt;
-      int ret = sqlite3_prepare_v2 (db_.raw(), sql, -1, &stmt, NULL);
-      stmt_.reset (new Statement_ (stmt));
+      int ret = db.db_->acquire (stmt_->sql_, &(stmt_->stmt_));
 
       if (ret != SQLITE_OK) {
         throw Error (db.errMsg());
@@ -45,7 +44,7 @@ namespace Sqlite {
 
     /** @brief Bind a placeholder to a value
      *
-     * This method should be used for all value types except @c int. This method
+     * This method should be used for all value types except integers. This method
      * returns the Statement object itself, allowing chains of calls.
      *
      * @param s  string representing the value to be bound
@@ -69,6 +68,19 @@ namespace Sqlite {
       return bind_ (sqlite3_bind_int (raw(), bindI_, i));
     }
 
+    /** @brief Bind a placeholder to a value
+     *
+     * This method should be used for 64-bit integer values. This method
+     * returns the Statement object itself, allowing chains of calls.
+     *
+     * @param i  integer value to be bound
+     *
+     * @return the Statement object itself
+     */
+    Statement & bind (sqlite3_int64 i) {
+      return bind_ (sqlite3_bind_int64 (raw(), bindI_, i));
+    }
+
     /** @brief Extract an @c int value from the current result row
      *
      * This method returns the Statement object itself, allowing chains of calls.
@@ -83,9 +95,23 @@ namespace Sqlite {
       return *this;
     }
 
+    /** @brief Extract a 64-bit integer value from the current result row
+     *
+     * This method returns the Statement object itself, allowing chains of calls.
+     *
+     * @param i  variable where the value will be stored
+     *
+     * @return the Statement object itself
+     */
+    Statement & operator>> (sqlite3_int64 & i) {
+      i = sqlite3_column_int64 (raw(), colI_);
+      ++colI_;
+      return *this;
+    }
+
     /** @brief Extract a value from the current result row
      *
-     * This method should be called for all value types except @c int. It
+     * This method should be called for all value types except integers. It
      * returns the Statement object itself, allowing chains of calls.
      *
      * @param s  variable where the value will be stored
@@ -101,7 +127,7 @@ namespace Sqlite {
     /** @brief Execute the statement or fetch the next result row
      *
      * Execute the SQL statement, after all placeholders have been bound. If no
-     * results are produced by the statement, return @c SQLITE_OK. Otherwise,
+     * results are produced by the statement, return @c SQLITE_DONE. Otherwise,
      * fetch the first result row and return @c SQLITE_ROW.
      *
      * Fetch a new row and return @c SQLITE_ROW for all subsequent calls. When
@@ -109,19 +135,36 @@ namespace Sqlite {
      *
      * Values can be extracted from the current result row using operator>>().
      *
-     * @return @c SQLITE_OK, @c SQLITE_ROW or @c SQLITE_DONE
-     * @throw Error
+     * @return @c SQLITE_ROW or @c SQLITE_DONE
+     * @throw Error for any other result code (e.g. a constraint violation, or a
+     *        database which stayed locked for longer than the busy timeout)
      */
     int step () {
       colI_ = 0;
       int ret = sqlite3_step (raw());
-      if (ret == SQLITE_ERROR) {
+      if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
         throw Error (db_.errMsg());
       }
 
       return ret;
     }
 
+    /** @brief Reset the statement
+     *
+     * Reset the statement to its initial state, ready to be executed again,
+     * and clear all values bound to its placeholders. This allows executing the
+     * same prepared statement several times with different values.
+     *
+     * @return the Statement object itself
+     */
+    Statement & reset () {
+      sqlite3_reset (raw());
+      sqlite3_clear_bindings (raw());
+      bindI_ = 1;
+      colI_ = 0;
+      return *this;
+    }
+
   private:
     Statement & bind_ (int ret) {
       if (ret != SQLITE_OK) {
@@ -135,9 +178,16 @@ namespace Sqlite {
     sqlite3_stmt * raw () { return stmt_->stmt_; }
 
     struct Statement_ {
+      std::shared_ptr<Database::Sqlite3_> db_;
+      const std::string sql_;
       sqlite3_stmt *stmt_;
-      Statement_ (sqlite3_stmt *stmt) : stmt_(stmt) {}
-      ~Statement_ () { sqlite3_finalize (stmt_); }
+      Statement_ (const std::shared_ptr<Database::Sqlite3_> & db, char const *const sql)
+        : db_ (db), sql_ (sql), stmt_ (NULL) {}
+      ~Statement_ () {
+        if (stmt_ != NULL) {
+          db_->release (sql_, stmt_);
+        }
+      }
     };
 
     Database & db_;
@@ -7,8 +7,17 @@ This example illustrates the use of @ref libsqlite
 
 #include "sqlite++/sqlite.hxx"
 #include <iostream>
+#include <vector>
+
+void check (bool expr) {
+  if (!expr) {
+    throw std::string ("Error");
+  }
+}
+
+void testDatabase () {
+  std::cout << "Testing Database..." << std::endl;
 
-int main () {
   //![main]
   using namespace Sqlite;
 
@@ -17,8 +26,9 @@ int main () {
   Database database ("/tmp/db.sqlite");
 
 
-  // Execute an SQL statement
-  database.execute ("CREATE TABLE IF NOT EXISTS foo ("
+  // Execute SQL statements
+  database.execute ("DROP TABLE IF EXISTS foo");
+  database.execute ("CREATE TABLE foo ("
                     "  id    INTEGER PRIMARY KEY,"
                     "  name  TEXT"
                     ")");
@@ -30,12 +40,18 @@ int main () {
     database.prepare ("INSERT INTO foo VALUES (NULL, ?)")
       .bind ("bar")  // bind it to a value, ...
       .step ();      // execute it
+
+    // Execute the same prepared statement several times
+    Statement insert = database.prepare ("INSERT INTO foo VALUES (NULL, ?)");
+    insert.bind ("baz").step();
+    insert.reset().bind ("qux").step();
   }
 
   // Prepare an SQL statement
   Statement statement = database.prepare ("SELECT id, name FROM foo");
 
   // Fetch all returned rows
+  std::vector<std::string> names;
   while (statement.step() == SQLITE_ROW) {
     // Fetch column values from the row, ...
     int id;
@@ -44,8 +60,125 @@ int main () {
 
     // and display them
     std::cerr << id << ": " << name << std::endl;
+    check (id == (int)names.size() + 1);
+    names.push_back (name);
   }
   //![main]
 
+  // The reset statement was executed again with its new binding
+  check (names.size() == 3);
+  check (names[0] == "bar" && names[1] == "baz" && names[2] == "qux");
+}
+
+void testStatementCache () {
+  std::cout << "Testing statement cache..." << std::endl;
+  using namespace Sqlite;
+
+  //![cache]
+  Database database (":memory:");
+  database.execute ("CREATE TABLE foo (x INTEGER)");
+  check (database.cacheHits() == 0 && database.cacheMisses() == 1);
+
+  // Compiled statements are kept once Statement objects are destroyed, ...
+  database.prepare ("INSERT INTO foo VALUES (?)").bind (1).step();
+  check (database.cacheHits() == 0 && database.cacheMisses() == 2);
+
+  // and reused for the same SQL code
+  database.prepare ("INSERT INTO foo VALUES (?)").bind (2).step();
+  database.prepare ("INSERT INTO foo VALUES (?)").bind (3).step();
+  check (database.cacheHits() == 2 && database.cacheMisses() == 2);
+  //![cache]
+
+  // A statement in use can not be shared: both of these get compiled
+  {
+    Statement a = database.prepare ("SELECT x FROM foo ORDER BY x");
+    Statement b = database.prepare ("SELECT x FROM foo ORDER BY x");
+    check (database.cacheHits() == 2 && database.cacheMisses() == 4);
+
+    // Leave both statements in the middle of their results
+    int x;
+    check (a.step() == SQLITE_ROW);
+    a >> x;
+    check (x == 1);
+    check (b.step() == SQLITE_ROW);
+    check (b.step() == SQLITE_ROW);
+    b >> x;
+    check (x == 2);
+  }
+
+  // Both are now cached, and reset: they return all rows again
+  for (int i = 0 ; i < 2 ; ++i) {
+    Statement select = database.prepare ("SELECT x FROM foo ORDER BY x");
+    std::vector<int> values;
+    while (select.step() == SQLITE_ROW) {
+      int x;
+      select >> x;
+      values.push_back (x);
+    }
+    check (values == std::vector<int> ({1, 2, 3}));
+  }
+  check (database.cacheHits() == 4 && database.cacheMisses() == 4);
+
+  // Bindings of a cached statement are cleared, even if it was never executed
+  database.prepare ("SELECT ? IS NULL").bind (42);
+  {
+    Statement isNull = database.prepare ("SELECT ? IS NULL");
+    int res = 0;
+    check (isNull.step() == SQLITE_ROW);
+    isNull >> res;
+    check (res == 1);
+  }
+
+  // Once reset, the statement can be rebound
+  {
+    Statement isNull = database.prepare ("SELECT ? IS NULL");
+    int res = 1;
+    check (isNull.bind (42).step() == SQLITE_ROW);
+    isNull >> res;
+    check (res == 0);
+  }
+  check (database.cacheHits() == 6 && database.cacheMisses() == 5);
+}
+
+void testErrors () {
+  std::cout << "Testing errors..." << std::endl;
+  using namespace Sqlite;
+
+  Database database (":memory:");
+  database.execute ("CREATE TABLE foo (x INTEGER UNIQUE)");
+  database.prepare ("INSERT INTO foo VALUES (?)").bind (1).step();
+
+  // Failures other than SQL errors (here a constraint violation) are reported
+  bool thrown = false;
+  try {
+    database.prepare ("INSERT INTO foo VALUES (?)").bind (1).step();
+  } catch (Error &) {
+    thrown = true;
+  }
+  check (thrown);
+
+  thrown = false;
+  try {
+    database.execute ("INSERT INTO foo VALUES (1)");
+  } catch (Error &) {
+    thrown = true;
+  }
+  check (thrown);
+
+  // The failed statement can be used again
+  check (database.prepare ("INSERT INTO foo VALUES (?)").bind (2).step() == SQLITE_DONE);
+}
+
+int main () {
+  try {
+    testDatabase();
+    testStatementCache();
+    testErrors();
+  }
+  catch (...) {
+    std::cerr << "Caught exception!" << std::endl;
+    return 1;
+  }
+
   return 0;
 }
@@ -1,165 +1,461 @@
 #pragma once
 
 #include "sqlite++/sqlite.hxx"
+#include "compileCommand.hxx"
 #include "json/json.h"
 
 #include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <thread>
 #include <sstream>
+#include <fstream>
 #include <iostream>
 
 class Storage {
 public:
-  Storage ()
-    : db_ (".ct.sqlite")
+  // Version of the database schema, stored in the database itself.
+  // Older databases are migrated when opened.
+  static const int schemaVersion = 5;
+
+  // Connections to the database can be opened in two modes:
+  // - the (only) Writer checks the database schema, migrating it if needed,
+  //   and switches the database to WAL mode;
+  // - Readers must not modify the database, but can query it concurrently
+  //   with the writer.
+  enum Mode { Writer, Reader };
+
+  Storage (Mode mode = Writer)
+    : db_ (".ct.sqlite"),
+      bulk_ (false),
+      dataVersion_ (-1),
+      symbols_   (db_, "symbols",   "usr"),
+      kinds_     (db_, "kinds",     "name"),
+      spellings_ (db_, "spellings", "name"),
+      flags_     (db_, "flags",     "args")
   {
-    db_.execute ("CREATE TABLE IF NOT EXISTS files ("
-                 "  id      INTEGER PRIMARY KEY,"
-                 "  name    TEXT,"
-                 "  indexed INTEGER"
-                 ")");
-    db_.execute ("CREATE TABLE IF NOT EXISTS commands ("
-                 "  fileId     INTEGER REFERENCES files(id),"
-                 "  directory  TEXT,"
-                 "  args       TEXT"
-                 ")");
-    db_.execute ("CREATE TABLE IF NOT EXISTS includes ("
-                 "  sourceId   INTEGER REFERENCES files(id),"
-                 "  includedId INTEGER REFERENCES files(id)"
-                 ")");
-    db_.execute ("CREATE TABLE IF NOT EXISTS tags ("
-                 "  fileId   INTEGER REFERENCES files(id),"
-                 "  usr      TEXT,"
-                 "  kind     TEXT,"
-                 "  spelling TEXT,"
-                 "  line1    INTEGER,"
-                 "  col1     INTEGER,"
-                 "  offset1  INTEGER,"
-                 "  line2    INTEGER,"
-                 "  col2     INTEGER,"
-                 "  offset2  INTEGER,"
-                 "  isDecl   BOOLEAN"
-                 ")");
-    db_.execute ("CREATE TABLE IF NOT EXISTS options ( "
-                 "  name   TEXT, "
-                 "  value  TEXT "
-                 ")");
+    db_.execute ("PRAGMA busy_timeout = 10000");
+    if (mode == Reader) {
+      return;
+    }
+
+    db_.execute ("PRAGMA journal_mode = WAL");
+    db_.execute ("PRAGMA synchronous = NORMAL");
+
+    int version;
+    {
+      Sqlite::Statement stmt = db_.prepare ("PRAGMA user_version");
+      stmt.step();
+      stmt >> version;
+    }
+
+    if (version > schemaVersion) {
+      std::ostringstream msg;
+      msg << "Unsupported database schema version " << version
+          << " (expected at most " << schemaVersion << ")";
+      throw std::runtime_error (msg.str());
+    }
+
+    auto transaction (beginTransaction());
+    migrate_ (version);
+    createIndexes_ ();
   }
 
+  // Compilation command of a translation unit, as stored in the database
+  //
+  // Sets of compiler flags are interned: translation units compiled with the
+  // same flags share the same flag set id.
+  struct Command {
+    std::string directory;
+    int         flags;      // flag set id (see flags())
+    int         position;   // position of the source file among the flags
+
+    bool operator== (const Command & other) const {
+      return directory == other.directory
+        && flags == other.flags
+        && position == other.position;
+    }
+  };
+
+  // All stored compilation commands, by source file name
+  std::map<std::string, Command> compileCommands () {
+    std::map<std::string, Command> ret;
+    Sqlite::Statement stmt
+      = db_.prepare ("SELECT files.name, commands.directory, "
+                     "       commands.flagsId, commands.position "
+                     "FROM commands "
+                     "INNER JOIN files ON files.id = commands.fileId");
+    while (stmt.step() == SQLITE_ROW) {
+      std::string fileName;
+      Command command;
+      stmt >> fileName >> command.directory >> command.flags >> command.position;
+      ret[fileName] = command;
+    }
+    return ret;
+  }
+
+  // Id of a flag set, or -1 if it is not stored
+  int findFlags (const std::vector<std::string> & flags) {
+    return flags_.find (serialize_ (flags));
+  }
+
+  // Arguments of a flag set
+  //
+  // Flag sets never change once stored, and their ids are never reused:
+  // parsed flags are cached for the lifetime of the connection.
+  const std::vector<std::string> & flags (int id) {
+    auto it = parsedFlags_.find (id);
+    if (it == parsedFlags_.end()) {
+      std::vector<std::string> args;
+      deserialize_ (flags_.value (id), args);
+      it = parsedFlags_.insert (std::make_pair (id, args)).first;
+    }
+    return it->second;
+  }
+
+  // Set the compilation command of a translation unit, and mark it as
+  // needing to be re-indexed
   int setCompileCommand (const std::string & fileName,
                          const std::string & directory,
-                         const std::vector<std::string> & args) {
-    int fileId = addFile_ (fileName);
+                         const CompileCommand::Flags & flags) {
+    int fileId = addFile (fileName);
     addInclude (fileId, fileId);
 
+    db_.prepare ("UPDATE files SET indexed=0 WHERE id=?")
+      .bind (fileId)
+      .step();
+
     db_.prepare ("DELETE FROM commands "
                  "WHERE fileId=?")
       .bind (fileId)
       .step();
 
-    db_.prepare ("INSERT INTO commands VALUES (?,?,?)")
+    db_.prepare ("INSERT INTO commands VALUES (?,?,?,?)")
       .bind (fileId)
       .bind (directory)
-      .bind (serialize_ (args))
+      .bind (flags_.id (serialize_ (flags.args)))
+      .bind (flags.position)
       .step();
 
     return fileId;
   }
 
-  void getCompileCommand (const std::string & fileName,
-                          std::string & directory,
-                          std::vector<std::string> & args) {
+  // Remove flag sets which are not used by any compilation command
+  void removeUnusedFlags () {
+    db_.execute ("DELETE FROM flags "
+                 "WHERE id NOT IN (SELECT flagsId FROM commands)");
+    flags_.forget();
+  }
+
+  // Get the command used to compile a file (or a translation unit including
+  // it), and return the id of its flag set
+  int getCompileCommand (const std::string & fileName,
+                         std::string & directory,
+                         std::vector<std::string> & args) {
     int fileId = fileId_ (fileName);
     Sqlite::Statement stmt
-      = db_.prepare ("SELECT commands.directory, commands.args "
+      = db_.prepare ("SELECT source.name, commands.directory, "
+                     "       commands.flagsId, commands.position "
                      "FROM includes "
                      "INNER JOIN commands ON includes.sourceId = commands.fileId "
+                     "INNER JOIN files AS source ON source.id = commands.fileId "
                      "WHERE includes.includedId = ?")
       .bind (fileId);
 
-    switch (stmt.step()) {
-    case SQLITE_DONE:
+    if (stmt.step() == SQLITE_DONE) {
       throw std::runtime_error ("no compilation command for file `"
                                 + fileName + "'");
-      break;
-    default:
-      std::string serializedArgs;
-      stmt >> directory >> serializedArgs;
-      deserialize_ (serializedArgs, args);
     }
+
+    std::string sourceName;
+    CompileCommand::Flags flags;
+    int flagsId;
+    stmt >> sourceName >> directory >> flagsId >> flags.position;
+    flags.args = this->flags (flagsId);
+    args = flags.command (sourceName);
+    return flagsId;
   }
 
-  std::string nextFile () {
-    Sqlite::Statement stmt
-      = db_.prepare ("SELECT included.name, included.indexed, source.name, "
-                     "       count(source.name) AS sourceCount "
-                     "FROM includes "
-                     "INNER JOIN files AS source ON source.id = includes.sourceId "
-                     "INNER JOIN files AS included ON included.id = includes.includedId "
-                     "GROUP BY included.id "
-                     "ORDER BY sourceCount ");
-    while (stmt.step() == SQLITE_ROW) {
-      std::string includedName;
-      int indexed;
-      std::string sourceName;
-      stmt >> includedName >> indexed >> sourceName;
+  // State of a file on disk, used to detect changes since it was last indexed
+  //
+  // Modification times (in nanoseconds) and sizes are used as a fast filter:
+  // the contents of a file are only hashed when they differ from those
+  // recorded at indexing time. Files which were touched without being
+  // modified are thus not re-indexed.
+  struct FileState {
+    sqlite3_int64 modified;     // modification time, in ns (0 if never indexed)
+    sqlite3_int64 size;
+    sqlite3_int64 hash;         // hash of the file contents
+
+    FileState ()
+      : modified (0), size (-1), hash (0)
+    { }
 
+    // Read the current state of a file, comparing it to the state it had when
+    // it was last indexed. Returns false if the file can not be read.
+    bool read (const std::string & fileName, const FileState & indexed) {
       struct stat fileStat;
-      if (stat (includedName.c_str(), &fileStat) != 0) {
-        std::cerr << "Warning: could not stat() file `" << includedName << "'" << std::endl
+      if (stat (fileName.c_str(), &fileStat) != 0) {
+        return false;
+      }
+      modified = (sqlite3_int64)fileStat.st_mtim.tv_sec * 1000000000
+        + fileStat.st_mtim.tv_nsec;
+      size = fileStat.st_size;
+
+      if (indexed.modified != 0 && !touchedSince (indexed)) {
+        hash = indexed.hash;
+        return true;
+      }
+      return hash_ (fileName);
+    }
+
+    // Whether the file metadata differ from those of `indexed`
+    bool touchedSince (const FileState & indexed) const {
+      return modified != indexed.modified || size != indexed.size;
+    }
+
+    // Whether the file needs to be re-indexed
+    bool changedSince (const FileState & indexed) const {
+      return indexed.modified == 0 || hash != indexed.hash;
+    }
+
+  private:
+    // 64-bit FNV-1a hash of the file contents
+    bool hash_ (const std::string & fileName) {
+      std::ifstream file (fileName.c_str(), std::ios::binary);
+      if (!file) {
+        return false;
+      }
+
+      sqlite3_uint64 h = 14695981039346656037ULL;
+      char buffer[65536];
+      while (file.read (buffer, sizeof(buffer)) || file.gcount() > 0) {
+        const std::streamsize n = file.gcount();
+        for (std::streamsize i = 0 ; i < n ; ++i) {
+          h ^= (unsigned char)buffer[i];
+          h *= 1099511628211ULL;
+        }
+      }
+      hash = (sqlite3_int64)h;
+      return true;
+    }
+  };
+
+  // Plan an index update
+  //
+  // Returns the list of translation units which have to be re-parsed so that
+  // all out-of-date files get re-indexed. The whole inclusion graph is loaded
+  // at once and all files are checked in parallel; translation units are then
+  // chosen so that each out-of-date file is covered by exactly one of them,
+  // starting with the files included in the fewest places.
+  //
+  // Translation units listed in `skip` are never returned.
+  std::vector<std::string> staleSources (const std::set<std::string> & skip = std::set<std::string>()) {
+    // Included files, along with the translation units including them
+    std::vector<std::string>              includedNames;
+    std::vector<FileState>                indexed;
+    std::vector<std::vector<std::string>> sources;
+
+    // Included files (as indices in the vectors above) for each translation unit
+    std::map<std::string, std::vector<unsigned int>> contents;
+
+    {
+      Sqlite::Statement stmt
+        = db_.prepare ("SELECT included.name, included.indexed, included.size, "
+                       "       included.hash, source.name "
+                       "FROM includes "
+                       "INNER JOIN files AS source ON source.id = includes.sourceId "
+                       "INNER JOIN files AS included ON included.id = includes.includedId "
+                       "ORDER BY includes.includedId, includes.sourceId");
+      while (stmt.step() == SQLITE_ROW) {
+        std::string includedName;
+        FileState includedIndexed;
+        std::string sourceName;
+        stmt >> includedName
+             >> includedIndexed.modified >> includedIndexed.size >> includedIndexed.hash
+             >> sourceName;
+
+        if (includedNames.empty() || includedNames.back() != includedName) {
+          includedNames.push_back (includedName);
+          indexed.push_back (includedIndexed);
+          sources.push_back (std::vector<std::string>());
+        }
+        sources.back().push_back (sourceName);
+        contents[sourceName].push_back (includedNames.size() - 1);
+      }
+    }
+
+    std::vector<FileState> current (includedNames.size());
+    std::vector<bool> readable (includedNames.size());
+    readFiles_ (includedNames, indexed, current, readable);
+
+    // Out-of-date files, starting with those included in the fewest places
+    std::vector<unsigned int> stale;
+    std::set<std::string> removed;
+    for (unsigned int i = 0 ; i < includedNames.size() ; ++i) {
+      if (!readable[i]) {
+        std::cerr << "Warning: could not read file `" << includedNames[i] << "'" << std::endl
                   << "  removing it from the index" << std::endl;
-        removeFile (includedName);
+        removeFile (includedNames[i]);
+        removed.insert (includedNames[i]);
+        continue;
+      }
+
+      if (current[i].changedSince (indexed[i])) {
+        if (skip.count (includedNames[i]) == 0) {
+          stale.push_back (i);
+        }
+      } else if (current[i].touchedSince (indexed[i])) {
+        // Same contents: record the new metadata to avoid hashing next time
+        setFileState_ (includedNames[i], current[i]);
+      }
+    }
+    std::stable_sort (stale.begin(), stale.end(),
+                      [&sources](unsigned int a, unsigned int b) {
+                        return sources[a].size() < sources[b].size();
+                      });
+
+    std::vector<std::string> plan;
+    std::vector<bool> covered (includedNames.size(), false);
+    for (auto i : stale) {
+      if (covered[i]) {
         continue;
       }
-      int modified = fileStat.st_mtime;
 
-      if (modified > indexed) {
-        return sourceName;
+      for (const auto & sourceName : sources[i]) {
+        if (skip.count (sourceName) > 0 || removed.count (sourceName) > 0) {
+          continue;
+        }
+
+        plan.push_back (sourceName);
+        for (auto j : contents[sourceName]) {
+          covered[j] = true;
+        }
+        break;
       }
     }
 
-    return "";
+    return plan;
   }
 
   void cleanIndex () {
     db_.execute ("DELETE FROM tags");
     db_.execute ("UPDATE files SET indexed = 0");
+    symbols_.clear();
+    kinds_.clear();
+    spellings_.clear();
+  }
+
+  void beginBulkIndex () {
+    // Tags are inserted in an empty table, without maintaining indexes
+    cleanIndex ();
+    db_.execute ("DROP INDEX IF EXISTS tagsByLocation");
+    db_.execute ("DROP INDEX IF EXISTS tagsByUsr");
+    bulk_ = true;
+  }
+
+  void endBulkIndex () {
+    bulk_ = false;
+    try {
+      createIndexes_ ();
+    } catch (Sqlite::Error &) {
+      // Tags were inserted without checking their uniqueness: remove
+      // duplicates and try again
+      db_.execute ("DELETE FROM tags WHERE rowid NOT IN ("
+                   "  SELECT MIN(rowid) FROM tags "
+                   "  GROUP BY fileId, offset1, offset2, usrId)");
+      createIndexes_ ();
+    }
   }
 
   Sqlite::Transaction beginTransaction () {
     return Sqlite::Transaction(db_);
   }
 
-  bool beginFile (const std::string & fileName) {
-    int fileId = addFile_ (fileName);
+  // Forget cached values, which may have been invalidated by another
+  // connection to the database, or are no longer worth their memory
+  void forgetCaches () {
+    symbols_.forget();
+    kinds_.forget();
+    spellings_.forget();
+  }
 
-    int indexed;
-    {
-      Sqlite::Statement stmt
-        = db_.prepare ("SELECT indexed FROM files WHERE id = ?")
-        .bind (fileId);
-      stmt.step();
-      stmt >> indexed;
+  // Forget cached values only if another connection committed changes to the
+  // database since the last call. SQLite maintains the data version of each
+  // connection, and bumps it whenever another connection commits.
+  void refreshCaches () {
+    Sqlite::Statement stmt = db_.prepare ("PRAGMA data_version");
+    sqlite3_int64 version = -1;
+    if (stmt.step() == SQLITE_ROW) {
+      stmt >> version;
     }
 
-    struct stat fileStat;
-    stat (fileName.c_str(), &fileStat);
-    int modified = fileStat.st_mtime;
+    if (version != dataVersion_) {
+      forgetCaches ();
+      dataVersion_ = version;
+    }
+  }
 
-    if (modified > indexed) {
-      db_.prepare ("DELETE FROM tags WHERE fileId=?").bind (fileId).step();
-      db_.prepare ("DELETE FROM includes WHERE sourceId=?").bind (fileId).step();
-      db_.prepare ("UPDATE files "
-                   "SET indexed=? "
-                   "WHERE id=?")
-        .bind (modified)
-        .bind (fileId)
+  // Files whose tags were replaced or removed through this connection since
+  // the last call
+  std::set<std::string> modifiedFiles () {
+    std::set<std::string> ret;
+    ret.swap (modified_);
+    return ret;
+  }
+
+  std::vector<std::string> fileNames () {
+    Sqlite::Statement stmt
+      = db_.prepare ("SELECT name FROM files");
+
+    std::vector<std::string> ret;
+    while (stmt.step() == SQLITE_ROW) {
+      std::string fileName;
+      stmt >> fileName;
+      ret.push_back (fileName);
+    }
+    return ret;
+  }
+
+  std::map<std::string, FileState> indexedFiles () {
+    Sqlite::Statement stmt
+      = db_.prepare ("SELECT name, indexed, size, hash FROM files");
+
+    std::map<std::string, FileState> ret;
+    while (stmt.step() == SQLITE_ROW) {
+      std::string fileName;
+      FileState indexed;
+      stmt >> fileName >> indexed.modified >> indexed.size >> indexed.hash;
+      ret[fileName] = indexed;
+    }
+    return ret;
+  }
+
+  int addFile (const std::string & fileName) {
+    int id = fileId_ (fileName);
+    if (id == -1) {
+      db_.prepare ("INSERT INTO files (name, indexed) VALUES (?, 0)")
+        .bind (fileName)
         .step();
-      return true;
-    } else {
-      return false;
+
+      id = db_.lastInsertRowId();
+    }
+    return id;
+  }
+
+  // Start re-indexing a file, whose current state has been read
+  void beginFile (const std::string & fileName, const FileState & state) {
+    int fileId = addFile (fileName);
+    modified_.insert (fileName);
+
+    if (!bulk_) {
+      db_.prepare ("DELETE FROM tags WHERE fileId=?").bind (fileId).step();
     }
+    db_.prepare ("DELETE FROM includes WHERE sourceId=?").bind (fileId).step();
+    setFileState_ (fileName, state);
   }
 
   void addInclude (const int includedId,
@@ -189,6 +485,7 @@ public:
 
   void removeFile (const std::string & fileName) {
     int fileId = fileId_ (fileName);
+    modified_.insert (fileName);
     db_
       .prepare ("DELETE FROM commands WHERE fileId = ?")
       .bind (fileId)
@@ -214,33 +511,86 @@ public:
       .step();
   }
 
-  void addTag (const std::string & usr,
-               const std::string & kind,
-               const std::string & spelling,
-               const std::string & fileName,
-               const int line1, const int col1, const int offset1,
-               const int line2, const int col2, const int offset2,
-               bool isDeclaration) {
-    int fileId = fileId_ (fileName);
-    if (fileId == -1) {
+  // Remove all files which are no longer included by any translation unit
+  void removeUnincludedFiles () {
+    std::vector<std::string> fileNames;
+    {
+      Sqlite::Statement stmt
+        = db_.prepare ("SELECT name FROM files "
+                       "WHERE id NOT IN (SELECT includedId FROM includes)");
+      while (stmt.step() == SQLITE_ROW) {
+        std::string fileName;
+        stmt >> fileName;
+        fileNames.push_back (fileName);
+      }
+    }
+    for (const auto & fileName : fileNames) {
+      removeFile (fileName);
+    }
+  }
+
+  struct Tag {
+    std::string usr;
+    std::string kind;
+    std::string spelling;
+    int line1;
+    int col1;
+    int offset1;
+    int line2;
+    int col2;
+    int offset2;
+    bool isDeclaration;
+  };
+
+  void addTag (const int fileId, const Tag & tag) {
+    tags_.push_back (std::make_pair (fileId, tag));
+  }
+
+  void flushTags () {
+    if (tags_.empty()) {
       return;
     }
 
-    Sqlite::Statement stmt =
-      db_.prepare ("SELECT * FROM tags "
-                   "WHERE fileId=? "
-                   "  AND usr=?"
-                   "  AND offset1=?"
-                   "  AND offset2=?")
-      .bind (fileId).bind (usr).bind (offset1).bind (offset2);
-    if (stmt.step() == SQLITE_DONE) { // no matching row
-      db_.prepare ("INSERT INTO tags VALUES (?,?,?,?,?,?,?,?,?,?,?)")
-        .bind(fileId) .bind(usr)  .bind(kind)    .bind(spelling)
-        .bind(line1)  .bind(col1) .bind(offset1)
-        .bind(line2)  .bind(col2) .bind(offset2)
-        .bind(isDeclaration)
-        .step();
+    // Deduplicate buffered tags, keeping the first occurrence of each
+    // (fileId, usr, offset1, offset2) key
+    auto less = [](const FileTag & a, const FileTag & b) {
+      const Tag & tagA = a.second;
+      const Tag & tagB = b.second;
+      if (a.first != b.first)             return a.first < b.first;
+      if (tagA.usr != tagB.usr)           return tagA.usr < tagB.usr;
+      if (tagA.offset1 != tagB.offset1)   return tagA.offset1 < tagB.offset1;
+      return tagA.offset2 < tagB.offset2;
+    };
+    auto equal = [&less](const FileTag & a, const FileTag & b) {
+      return !less (a, b) && !less (b, a);
+    };
+    std::stable_sort (tags_.begin(), tags_.end(), less);
+    tags_.erase (std::unique (tags_.begin(), tags_.end(), equal),
+                 tags_.end());
+
+    // Insert them using multi-row statements
+    const long rows = 64;
+    Sqlite::Statement stmt = db_.prepare (insertTags_ (rows).c_str());
+
+    auto it  = tags_.begin();
+    auto end = tags_.end();
+    while (end - it >= rows) {
+      stmt.reset();
+      for (long i = 0 ; i < rows ; ++i, ++it) {
+        bindTag_ (stmt, *it);
+      }
+      stmt.step();
+    }
+
+    if (it != end) {
+      Sqlite::Statement last = db_.prepare (insertTags_ (end - it).c_str());
+      for ( ; it != end ; ++it) {
+        bindTag_ (last, *it);
+      }
+      last.step();
     }
+
+    tags_.clear();
   }
 
   struct Reference {
@@ -305,56 +655,95 @@ public:
     }
   };
 
-  std::vector<RefDef> findDefinition (const std::string fileName,
-                       int offset) {
+  // Reference tags located in a file. Interned strings are left as ids, to be
+  // resolved with usr(), kind() and spelling().
+  struct FileReference {
+    int offset1;
+    int offset2;
+    int line1;
+    int line2;
+    int col1;
+    int col2;
+    int usrId;
+    int kindId;
+    int spellingId;
+  };
+
+  std::vector<FileReference> fileReferences (const std::string & fileName) {
     int fileId = fileId_ (fileName);
     Sqlite::Statement stmt =
-      db_.prepare ("SELECT ref.offset1, ref.offset2, ref.kind, ref.spelling,"
-                   "       def.usr, defFile.name,"
-                   "       def.line1, def.line2, def.col1, def.col2, "
-                   "       def.kind, def.spelling "
-                   "FROM tags AS ref "
-                   "INNER JOIN tags AS def ON def.usr = ref.usr "
-                   "INNER JOIN files AS defFile ON def.fileId = defFile.id "
-                   "WHERE def.isDecl = 1 "
-                   "  AND ref.fileId = ?  "
-                   "  AND ref.offset1 <= ? "
-                   "  AND ref.offset2 >= ? "
-                   "ORDER BY (ref.offset2 - ref.offset1)")
-      .bind (fileId)
-      .bind (offset)
-      .bind (offset);
+      db_.prepare ("SELECT offset1, offset2, line1, line2, col1, col2, "
+                   "       usrId, kindId, spellingId "
+                   "FROM tags "
+                   "WHERE fileId = ? "
+                   "ORDER BY offset1")
+      .bind (fileId);
 
-    std::vector<RefDef> ret;
+    std::vector<FileReference> ret;
     while (stmt.step() == SQLITE_ROW) {
-      RefDef refDef;
-      Reference & ref = refDef.ref;
-      Definition & def = refDef.def;
+      FileReference ref;
+      stmt >> ref.offset1 >> ref.offset2
+           >> ref.line1 >> ref.line2 >> ref.col1 >> ref.col2
+           >> ref.usrId >> ref.kindId >> ref.spellingId;
+      ret.push_back (ref);
+    }
+    return ret;
+  }
 
-      stmt >> ref.offset1 >> ref.offset2 >> ref.kind >> ref.spelling
-           >> def.usr >> def.file
+  // Declarations of a symbol
+  std::vector<Definition> definitions (int usrId) {
+    Sqlite::Statement stmt =
+      db_.prepare ("SELECT defFile.name, def.line1, def.line2, def.col1, def.col2, "
+                   "       def.kindId, def.spellingId "
+                   "FROM tags AS def "
+                   "INNER JOIN files AS defFile ON def.fileId = defFile.id "
+                   "WHERE def.usrId = ? "
+                   "  AND def.isDecl = 1")
+      .bind (usrId);
+
+    std::vector<Definition> ret;
+    while (stmt.step() == SQLITE_ROW) {
+      Definition def;
+      int defKind, defSpelling;
+      stmt >> def.file
            >> def.line1 >> def.line2 >> def.col1 >> def.col2
-           >> def.kind >> def.spelling;
-      ref.file = fileName;
-      ret.push_back(refDef);
+           >> defKind >> defSpelling;
+      def.usr      = symbols_.value (usrId);
+      def.kind     = kinds_.value (defKind);
+      def.spelling = spellings_.value (defSpelling);
+      ret.push_back (def);
     }
     return ret;
   }
 
+  const std::string & usr      (int id) { return symbols_.value (id); }
+  const std::string & kind     (int id) { return kinds_.value (id); }
+  const std::string & spelling (int id) { return spellings_.value (id); }
+
+  // References to a symbol, grouped by file
   std::vector<Reference> grep (const std::string usr) {
+    std::vector<Reference> ret;
+
+    int usrId = symbols_.find (usr);
+    if (usrId == -1) {
+      return ret;
+    }
+
     Sqlite::Statement stmt =
       db_.prepare("SELECT ref.line1, ref.line2, ref.col1, ref.col2, "
-                  "       ref.offset1, ref.offset2, refFile.name, ref.kind "
+                  "       ref.offset1, ref.offset2, refFile.name, ref.kindId "
                   "FROM tags AS ref "
                   "INNER JOIN files AS refFile ON ref.fileId = refFile.id "
-                  "WHERE ref.usr = ?")
-      .bind (usr);
+                  "WHERE ref.usrId = ? "
+                  "ORDER BY ref.fileId, ref.offset1")
+      .bind (usrId);
 
-    std::vector<Reference> ret;
     while (stmt.step() == SQLITE_ROW) {
       Reference ref;
+      int kind;
       stmt >> ref.line1 >> ref.line2 >> ref.col1 >> ref.col2
-           >> ref.offset1 >> ref.offset2 >> ref.file >> ref.kind;
+           >> ref.offset1 >> ref.offset2 >> ref.file >> kind;
+      ref.kind = kinds_.value (kind);
       ret.push_back (ref);
     }
     return ret;
@@ -394,6 +783,19 @@ public:
     return ret;
   }
 
+  std::string getOption (const std::string & name, const std::string & defaultValue) {
+    Sqlite::Statement stmt =
+      db_.prepare ("SELECT value FROM options "
+                   "WHERE name = ?")
+      .bind (name);
+
+    std::string ret = defaultValue;
+    if (stmt.step() == SQLITE_ROW) {
+      stmt >> ret;
+    }
+    return ret;
+  }
+
   struct Vector {};
   std::vector<std::string> getOption (const std::string & name, const Vector & v) {
     std::vector<std::string> ret;
@@ -402,6 +804,373 @@ public:
   }
 
 private:
+  // Table of interned strings
+  //
+  // Each distinct string is stored once in the database and referred to by
+  // its integer id. Both mappings are cached in memory.
+  class StringTable {
+  public:
+    StringTable (Sqlite::Database & db,
+                 const std::string & table, const std::string & column)
+      : db_    (db),
+        find_  ("SELECT id FROM " + table + " WHERE " + column + " = ?"),
+        value_ ("SELECT " + column + " FROM " + table + " WHERE id = ?"),
+        insert_("INSERT INTO " + table + " VALUES (NULL, ?)"),
+        clear_ ("DELETE FROM " + table)
+    { }
+
+    // Get the id of a string, or -1 if it is not in the table
+    int find (const std::string & value) {
+      auto it = ids_.find (value);
+      if (it != ids_.end()) {
+        return it->second;
+      }
+
+      Sqlite::Statement stmt = db_.prepare (find_.c_str()).bind (value);
+      int id = -1;
+      if (stmt.step() == SQLITE_ROW) {
+        stmt >> id;
+        ids_[value] = id;
+      }
+      return id;
+    }
+
+    // Get the id of a string, adding it to the table if needed
+    int id (const std::string & value) {
+      int id = find (value);
+      if (id == -1) {
+        db_.prepare (insert_.c_str()).bind (value).step();
+        id = db_.lastInsertRowId();
+        ids_[value] = id;
+      }
+      return id;
+    }
+
+    // Get the string associated to an id
+    const std::string & value (int id) {
+      auto it = values_.find (id);
+      if (it == values_.end()) {
+        Sqlite::Statement stmt = db_.prepare (value_.c_str()).bind (id);
+        std::string value;
+        if (stmt.step() == SQLITE_ROW) {
+          stmt >> value;
+        }
+        it = values_.insert (std::make_pair (id, value)).first;
+      }
+      return it->second;
+    }
+
+    void clear () {
+      db_.execute (clear_.c_str());
+      forget();
+    }
+
+    // Empty the caches, leaving the table untouched
+    void forget () {
+      ids_.clear();
+      values_.clear();
+    }
+
+  private:
+    Sqlite::Database & db_;
+    const std::string find_;
+    const std::string value_;
+    const std::string insert_;
+    const std::string clear_;
+    std::map<std::string, int> ids_;
+    std::map<int, std::string> values_;
+  };
+
+  void migrate_ (int version) {
+    switch (version) {
+    case 0: // Unversioned database
+      db_.execute ("CREATE TABLE IF NOT EXISTS files ("
+                   "  id      INTEGER PRIMARY KEY,"
+                   "  name    TEXT,"
+                   "  indexed INTEGER"
+                   ")");
+      db_.execute ("CREATE TABLE IF NOT EXISTS commands ("
+                   "  fileId     INTEGER REFERENCES files(id),"
+                   "  directory  TEXT,"
+                   "  args       TEXT"
+                   ")");
+      db_.execute ("CREATE TABLE IF NOT EXISTS includes ("
+                   "  sourceId   INTEGER REFERENCES files(id),"
+                   "  includedId INTEGER REFERENCES files(id)"
+                   ")");
+      db_.execute ("CREATE TABLE IF NOT EXISTS tags ("
+                   "  fileId   INTEGER REFERENCES files(id),"
+                   "  usr      TEXT,"
+                   "  kind     TEXT,"
+                   "  spelling TEXT,"
+                   "  line1    INTEGER,"
+                   "  col1     INTEGER,"
+                   "  offset1  INTEGER,"
+                   "  line2    INTEGER,"
+                   "  col2     INTEGER,"
+                   "  offset2  INTEGER,"
+                   "  isDecl   BOOLEAN"
+                   ")");
+      db_.execute ("CREATE TABLE IF NOT EXISTS options ( "
+                   "  name   TEXT, "
+                   "  value  TEXT "
+                   ")");
+      db_.execute ("DROP INDEX IF EXISTS uniqueTags");
+
+    case 1: // Interned USRs, kinds and spellings
+      db_.execute ("CREATE TABLE symbols ("
+                   "  id   INTEGER PRIMARY KEY,"
+                   "  usr  TEXT UNIQUE"
+                   ")");
+      db_.execute ("CREATE TABLE kinds ("
+                   "  id   INTEGER PRIMARY KEY,"
+                   "  name TEXT UNIQUE"
+                   ")");
+      db_.execute ("CREATE TABLE spellings ("
+                   "  id   INTEGER PRIMARY KEY,"
+                   "  name TEXT UNIQUE"
+                   ")");
+      db_.execute ("INSERT INTO symbols (usr)    SELECT DISTINCT usr      FROM tags");
+      db_.execute ("INSERT INTO kinds (name)     SELECT DISTINCT kind     FROM tags");
+      db_.execute ("INSERT INTO spellings (name) SELECT DISTINCT spelling FROM tags");
+
+      db_.execute ("DROP INDEX IF EXISTS tagsByLocation");
+      db_.execute ("DROP INDEX IF EXISTS tagsByUsr");
+      db_.execute ("ALTER TABLE tags RENAME TO oldTags");
+      db_.execute ("CREATE TABLE tags ("
+                   "  fileId     INTEGER REFERENCES files(id),"
+                   "  usrId      INTEGER REFERENCES symbols(id),"
+                   "  kindId     INTEGER REFERENCES kinds(id),"
+                   "  spellingId INTEGER REFERENCES spellings(id),"
+                   "  line1      INTEGER,"
+                   "  col1       INTEGER,"
+                   "  offset1    INTEGER,"
+                   "  line2      INTEGER,"
+                   "  col2       INTEGER,"
+                   "  offset2    INTEGER,"
+                   "  isDecl     BOOLEAN"
+                   ")");
+      db_.execute ("INSERT INTO tags "
+                   "SELECT oldTags.fileId, symbols.id, kinds.id, spellings.id,"
+                   "       line1, col1, offset1, line2, col2, offset2, isDecl "
+                   "FROM oldTags "
+                   "INNER JOIN symbols   ON symbols.usr    = oldTags.usr "
+                   "INNER JOIN kinds     ON kinds.name     = oldTags.kind "
+                   "INNER JOIN spellings ON spellings.name = oldTags.spelling");
+      db_.execute ("DROP TABLE oldTags");
+
+    case 2: // Nanosecond modification times, sizes and content hashes
+      db_.execute ("ALTER TABLE files ADD COLUMN size INTEGER DEFAULT -1");
+      db_.execute ("ALTER TABLE files ADD COLUMN hash INTEGER DEFAULT 0");
+      db_.execute ("UPDATE files SET indexed = indexed * 1000000000");
+
+    case 3: // Compile commands independent of the working directory
+      {
+        std::vector<std::pair<int, std::string>> commands;
+        {
+          Sqlite::Statement stmt = db_.prepare ("SELECT rowid, directory, args FROM commands");
+          while (stmt.step() == SQLITE_ROW) {
+            int rowId;
+            std::string directory, serializedArgs;
+            stmt >> rowId >> directory >> serializedArgs;
+
+            std::vector<std::string> args;
+            deserialize_ (serializedArgs, args);
+            commands.push_back (std::make_pair (rowId,
+                                                serialize_ (CompileCommand::normalize (directory, args))));
+          }
+        }
+        for (const auto & command : commands) {
+          db_.prepare ("UPDATE commands SET args=? WHERE rowid=?")
+            .bind (command.second)
+            .bind (command.first)
+            .step();
+        }
+
+        // Source files are named by their canonical path
+        struct Source {
+          std::string fileName;
+          std::string canonical;
+        };
+        std::vector<Source> sources;
+        {
+          Sqlite::Statement stmt
+            = db_.prepare ("SELECT commands.directory, files.name "
+                           "FROM commands "
+                           "INNER JOIN files ON files.id = commands.fileId");
+          while (stmt.step() == SQLITE_ROW) {
+            std::string directory;
+            Source source;
+            stmt >> directory >> source.fileName;
+
+            source.canonical = CompileCommand::fileName (directory, source.fileName);
+            if (source.canonical != source.fileName) {
+              sources.push_back (source);
+            }
+          }
+        }
+        for (const auto & source : sources) {
+          const int fileId      = fileId_ (source.fileName);
+          const int canonicalId = fileId_ (source.canonical);
+          if (canonicalId == -1) {
+            db_.prepare ("UPDATE files SET name=? WHERE id=?")
+              .bind (source.canonical)
+              .bind (fileId)
+              .step();
+            continue;
+          }
+
+          // The canonical file is already known (e.g. as an included file, or
+          // with another command): it takes over the command if it has none,
+          // and gets re-indexed
+          Sqlite::Statement stmt
+            = db_.prepare ("SELECT COUNT(*) FROM commands WHERE fileId=?")
+            .bind (canonicalId);
+          int commands = 0;
+          if (stmt.step() == SQLITE_ROW) {
+            stmt >> commands;
+          }
+          if (commands == 0) {
+            db_.prepare ("UPDATE commands SET fileId=? WHERE fileId=?")
+              .bind (canonicalId)
+              .bind (fileId)
+              .step();
+          }
+          addInclude (canonicalId, canonicalId);
+          db_.prepare ("UPDATE files SET indexed=0 WHERE id=?")
+            .bind (canonicalId)
+            .step();
+          removeFile (source.fileName);
+        }
+
+        // Files only included by the removed ones
+        removeUnincludedFiles ();
+      }
+
+    case 4: // Interned flag sets
+      db_.execute ("CREATE TABLE flags ("
+                   "  id   INTEGER PRIMARY KEY AUTOINCREMENT,"
+                   "  args TEXT UNIQUE"
+                   ")");
+      db_.execute ("DROP INDEX IF EXISTS commandsByFile");
+      db_.execute ("ALTER TABLE commands RENAME TO oldCommands");
+      db_.execute ("CREATE TABLE commands ("
+                   "  fileId    INTEGER REFERENCES files(id),"
+                   "  directory TEXT,"
+                   "  flagsId   INTEGER REFERENCES flags(id),"
+                   "  position  INTEGER"
+                   ")");
+      {
+        struct Row {
+          int                   fileId;
+          std::string           directory;
+          CompileCommand::Flags flags;
+        };
+        std::vector<Row> commands;
+        {
+          Sqlite::Statement stmt
+            = db_.prepare ("SELECT oldCommands.fileId, files.name, "
+                           "       oldCommands.directory, oldCommands.args "
+                           "FROM oldCommands "
+                           "INNER JOIN files ON files.id = oldCommands.fileId");
+          while (stmt.step() == SQLITE_ROW) {
+            Row row;
+            std::string fileName, serializedArgs;
+            stmt >> row.fileId >> fileName >> row.directory >> serializedArgs;
+
+            std::vector<std::string> args;
+            deserialize_ (serializedArgs, args);
+            row.flags = CompileCommand::flags (args, fileName);
+            commands.push_back (row);
+          }
+        }
+        for (const auto & row : commands) {
+          db_.prepare ("INSERT INTO commands VALUES (?,?,?,?)")
+            .bind (row.fileId)
+            .bind (row.directory)
+            .bind (flags_.id (serialize_ (row.flags.args)))
+            .bind (row.flags.position)
+            .step();
+        }
+      }
+      db_.execute ("DROP TABLE oldCommands");
+    }
+
+    std::ostringstream pragma;
+    pragma << "PRAGMA user_version = " << schemaVersion;
+    db_.execute (pragma.str().c_str());
+  }
+
+  void createIndexes_ () {
+    // fileId_()
+    db_.execute ("CREATE UNIQUE INDEX IF NOT EXISTS filesByName "
+                 "ON files (name)");
+
+    // getCompileCommand(), removeFile()
+    db_.execute ("CREATE INDEX IF NOT EXISTS commandsByFile "
+                 "ON commands (fileId)");
+
+    // addInclude(), beginFile(), removeFile()
+    db_.execute ("CREATE UNIQUE INDEX IF NOT EXISTS includesBySource "
+                 "ON includes (sourceId, includedId)");
+
+    // getCompileCommand(), removeFile()
+    db_.execute ("CREATE INDEX IF NOT EXISTS includesByIncluded "
+                 "ON includes (includedId, sourceId)");
+
+    // Tags uniqueness, references of a file in fileReferences(),
+    // beginFile(), removeFile()
+    db_.execute ("CREATE UNIQUE INDEX IF NOT EXISTS tagsByLocation "
+                 "ON tags (fileId, offset1, offset2, usrId)");
+
+    // Definitions in definitions(), references in grep()
+    db_.execute ("CREATE INDEX IF NOT EXISTS tagsByUsr "
+                 "ON tags (usrId, isDecl, fileId, line1, line2, col1, col2, "
+                 "         offset1, offset2, kindId, spellingId)");
+  }
+
+  // Read the current state of all given files (see FileState::read).
+  // Files are processed in parallel.
+  static void readFiles_ (const std::vector<std::string> & fileNames,
+                          const std::vector<FileState> & indexed,
+                          std::vector<FileState> & current,
+                          std::vector<bool> & readable) {
+    const unsigned int minFilesPerThread = 256;
+    const unsigned int threads
+      = std::max (1u, std::min (std::thread::hardware_concurrency(),
+                                (unsigned int)(fileNames.size() / minFilesPerThread)));
+
+    // std::vector<bool> elements can not be written concurrently
+    std::vector<char> ok (fileNames.size());
+    auto work = [&](unsigned int first) {
+      for (unsigned int i = first ; i < fileNames.size() ; i += threads) {
+        ok[i] = current[i].read (fileNames[i], indexed[i]);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1 ; i < threads ; ++i) {
+      workers.push_back (std::thread (work, i));
+    }
+    work (0);
+    for (auto & worker : workers) {
+      worker.join();
+    }
+
+    readable.assign (ok.begin(), ok.end());
+  }
+
+  void setFileState_ (const std::string & fileName, const FileState & state) {
+    db_.prepare ("UPDATE files "
+                 "SET indexed=?, size=?, hash=? "
+                 "WHERE name=?")
+      .bind (state.modified)
+      .bind (state.size)
+      .bind (state.hash)
+      .bind (fileName)
+      .step();
+  }
+
   int fileId_ (const std::string & fileName) {
     Sqlite::Statement stmt
       = db_.prepare ("SELECT id FROM files WHERE name=?")
@@ -415,16 +1184,28 @@ private:
     return id;
   }
 
-  int addFile_ (const std::string & fileName) {
-    int id = fileId_ (fileName);
-    if (id == -1) {
-      db_.prepare ("INSERT INTO files VALUES (NULL, ?, 0)")
-        .bind (fileName)
-        .step();
+  typedef std::pair<int, Tag> FileTag;
 
-      id = db_.lastInsertRowId();
+  std::string insertTags_ (unsigned int rows) {
+    std::string sql = "INSERT OR IGNORE INTO tags VALUES ";
+    for (unsigned int i = 0 ; i < rows ; ++i) {
+      if (i > 0) {
+        sql += ",";
+      }
+      sql += "(?,?,?,?,?,?,?,?,?,?,?)";
     }
-    return id;
+    return sql;
+  }
+
+  void bindTag_ (Sqlite::Statement & stmt, const FileTag & fileTag) {
+    const Tag & tag = fileTag.second;
+    stmt.bind(fileTag.first)
+        .bind(symbols_.id (tag.usr))
+        .bind(kinds_.id (tag.kind))
+        .bind(spellings_.id (tag.spelling))
+        .bind(tag.line1) .bind(tag.col1) .bind(tag.offset1)
+        .bind(tag.line2) .bind(tag.col2) .bind(tag.offset2)
+        .bind(tag.isDeclaration);
   }
 
   std::string serialize_ (const std::vector<std::string> & v) {
@@ -452,4 +1233,13 @@ private:
   }
 
   Sqlite::Database db_;
+  std::vector<FileTag> tags_;
+  bool bulk_;
+  sqlite3_int64 dataVersion_;
+  std::set<std::string> modified_;
+  StringTable symbols_;
+  StringTable kinds_;
+  StringTable spellings_;
+  StringTable flags_;
+  std::map<int, std::vector<std::string>> parsedFlags_;
 };
@@ -0,0 +1,266 @@
+#include "compileCommand.hxx"
+#include <iostream>
+#include <sstream>
+
+void check (bool expr) {
+  if (!expr) {
+    throw std::string ("Error");
+  }
+}
+
+// Whether reading all entries of `json` fails
+bool readFails (const std::string & json) {
+  std::istringstream input (json);
+  CompileCommand::Reader reader (input);
+  CompileCommand::Entry entry;
+  try {
+    while (reader.next (entry)) { }
+  } catch (std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+
+void testSplit () {
+  std::cout << "Testing split..." << std::endl;
+  using CompileCommand::split;
+
+  // Blanks separate arguments
+  check (split ("  c++\t-c  a.cxx\n") == std::vector<std::string> ({"c++", "-c", "a.cxx"}));
+  check (split ("") == std::vector<std::string> ());
+
+  // Quotes
+  check (split ("c++ -DA='x y' '' \"-DB=1 2\" 'a'\"b\"c")
+         == std::vector<std::string> ({"c++", "-DA=x y", "", "-DB=1 2", "abc"}));
+  check (split ("'\"' \"'\"") == std::vector<std::string> ({"\"", "'"}));
+
+  // Backslashes
+  check (split ("a\\ b \\'c\\\\") == std::vector<std::string> ({"a b", "'c\\"}));
+  check (split ("'\\n' \"\\n\\\"\\\\\"")
+         == std::vector<std::string> ({"\\n", "\\n\"\\"}));
+
+  // Unterminated quotes
+  for (const char * command : {"c++ 'a.cxx", "c++ \"a.cxx", "c++ \"a.cxx\\\""}) {
+    bool thrown = false;
+    try {
+      split (command);
+    } catch (std::runtime_error &) {
+      thrown = true;
+    }
+    check (thrown);
+  }
+}
+
+
+void testReader () {
+  std::cout << "Testing Reader..." << std::endl;
+
+  std::istringstream input (
+    "[\n"
+    "  {\"directory\": \"/src\",\n"
+    "   \"command\": \"c++ -DNAME=\\\"x\\\" -c caf\\u00e9.cxx\",\n"
+    "   \"file\": \"caf\\u00E9.cxx\"},\n"
+    "  {\"file\": \"\\ud83d\\ude00\\/b.cxx\", \"directory\": \"/src\",\n"
+    "   \"output\": \"b.o\", \"size\": -1.5e3, \"flags\": [true, null, {\"a\": [\"]\"]}],\n"
+    "   \"arguments\": [\"cc\", \"-I\", \"inc dir\", \"b.cxx\"],\n"
+    "   \"command\": \"ignored\"},\n"
+    "  {\"directory\": \"/src\", \"arguments\": [\"cc\", \"-O2\", \"a.cxx\"], \"file\": \"a.cxx\"}\n"
+    "]\n");
+
+  CompileCommand::Reader reader (input);
+  CompileCommand::Entry entry;
+
+  // "command" form, with escapes
+  check (reader.next (entry));
+  check (entry.directory == "/src");
+  check (entry.file == "caf\xc3\xa9.cxx");
+  check (entry.args == std::vector<std::string> ({"-DNAME=x", "-c", "caf\xc3\xa9.cxx"}));
+
+  // "arguments" form, taking precedence over "command"; unknown members
+  // are skipped
+  check (reader.next (entry));
+  check (entry.file == "\xf0\x9f\x98\x80/b.cxx");
+  check (entry.args == std::vector<std::string> ({"-I", "inc dir", "b.cxx"}));
+
+  // Duplicate entries are all returned, in order
+  check (reader.next (entry));
+  check (entry.file == "a.cxx");
+  check (entry.args == std::vector<std::string> ({"-O2", "a.cxx"}));
+
+  check (!reader.next (entry));
+  check (!reader.next (entry));
+  check (reader.count() == 3);
+
+  // Empty database
+  std::istringstream empty (" [ ] ");
+  CompileCommand::Reader emptyReader (empty);
+  check (!emptyReader.next (entry));
+  check (emptyReader.count() == 0);
+}
+
+
+void testReaderErrors () {
+  std::cout << "Testing Reader errors..." << std::endl;
+
+  const std::string entry = "{\"directory\": \"/src\", \"file\": \"a.cxx\", \"command\": \"cc a.cxx\"}";
+  check (!readFails ("[" + entry + "," + entry + "]"));
+
+  // Truncated input
+  check (readFails (""));
+  check (readFails ("["));
+  check (readFails ("[" + entry));
+  check (readFails ("[" + entry + ","));
+  check (readFails ("[" + entry.substr (0, entry.size() / 2)));
+  check (readFails ("[{\"file\": \"a.cxx\", \"arguments\": [\"cc\""));
+  check (readFails ("[{\"file\": \"a.cxx\", \"x\": {\"y\": [1, "));
+  check (readFails ("[{\"file\": \"a\\u00"));
+
+  // Invalid entries
+  check (readFails ("[{}]"));
+  check (readFails ("[{\"directory\": \"/src\", \"command\": \"cc a.cxx\"}]"));
+  check (readFails ("[{\"file\": \"a.cxx\"}]"));
+  check (readFails ("[{\"file\": \"a.cxx\", \"command\": \"cc 'a.cxx\"}]"));
+  check (readFails ("[{\"file\": \"a\\u00zz.cxx\", \"command\": \"cc\"}]"));
+
+  // Errors are reported with a line number
+  std::istringstream input ("[\n" + entry + ",\n{\"file\": \"b.cxx\", \"command\": \"cc \\\"b.cxx\"}]");
+  CompileCommand::Reader reader (input);
+  CompileCommand::Entry e;
+  check (reader.next (e));
+  try {
+    reader.next (e);
+    check (false);
+  } catch (std::runtime_error & err) {
+    check (std::string (err.what()).find ("line 3: unterminated double quote") == 0);
+  }
+}
+
+
+void testNormalize () {
+  std::cout << "Testing normalize..." << std::endl;
+  typedef std::vector<std::string> Args;
+
+  struct {
+    const char * directory;
+    Args         args;
+    Args         expected;
+  } cases[] = {
+    // Source files and separate paths
+    {"/src", {"-c", "a.cxx", "-I", "inc", "-isystem", "/usr/inc", "-o", "a.o"},
+     {"-c", "/src/a.cxx", "-I", "/src/inc", "-isystem", "/usr/inc", "-o", "/src/a.o"}},
+    {"/src/", {"-include-pch", "pch/foo.pch", "-MF", "dep/a.d", "a.cxx"},
+     {"-include-pch", "/src/pch/foo.pch", "-MF", "/src/dep/a.d", "/src/a.cxx"}},
+
+    // Joined paths
+    {"/src", {"-Iinc", "-I/usr/inc", "--sysroot=root", "-oa.o", "-Lpath"},
+     {"-I/src/inc", "-I/usr/inc", "--sysroot=/src/root", "-o/src/a.o", "-L/src/path"}},
+
+    // "./" prefixes and "."
+    {"/src", {"-I.", "-I", "./inc", "./a.cxx", "././b.cxx"},
+     {"-I/src", "-I", "/src/inc", "/src/a.cxx", "/src/b.cxx"}},
+
+    // Values which are not paths
+    {"/src", {"-D", "NAME", "-x", "c++", "--param", "ssp-buffer-size=4", "-DX=y/z", "a.cxx"},
+     {"-D", "NAME", "-x", "c++", "--param", "ssp-buffer-size=4", "-DX=y/z", "/src/a.cxx"}},
+    {"/src", {"-mllvm", "opt", "-Xlinker", "lib", "-arch", "x86_64"},
+     {"-mllvm", "opt", "-Xlinker", "lib", "-arch", "x86_64"}},
+
+    // Paths passed to the frontend
+    {"/src", {"-Xclang", "-include-pch", "-Xclang", "pch/foo.pch", "a.cxx"},
+     {"-Xclang", "-include-pch", "-Xclang", "/src/pch/foo.pch", "/src/a.cxx"}},
+    {"/src", {"-Xclang", "-fcolor-diagnostics", "-Xclang", "-include-pch"},
+     {"-Xclang", "-fcolor-diagnostics", "-Xclang", "-include-pch"}},
+
+    // Explicit working directory
+    {"/src", {"-working-directory", "build", "-I", "inc", "a.cxx"},
+     {"-I", "/src/build/inc", "/src/build/a.cxx"}},
+    {"/src", {"-I", "inc", "-working-directory", "/build", "a.cxx"},
+     {"-I", "/build/inc", "/build/a.cxx"}},
+
+    // Empty arguments are dropped; trailing options are kept
+    {"/src", {"", "a.cxx", "-I"},
+     {"/src/a.cxx", "-I"}},
+  };
+
+  for (const auto & c : cases) {
+    check (CompileCommand::normalize (c.directory, c.args) == c.expected);
+  }
+}
+
+
+void testFlags () {
+  std::cout << "Testing flags..." << std::endl;
+  typedef std::vector<std::string> Args;
+
+  struct {
+    Args         args;
+    const char * source;
+    Args         expected;
+    int          position;
+  } cases[] = {
+    // Per-file outputs are stripped, and the source position is recorded
+    {{"-c", "/src/a.cxx", "-o", "/src/a.o", "-MF", "/src/a.d", "-MT", "a.o", "-O2"},
+     "/src/a.cxx",
+     {"-c", "-O2"}, 1},
+    {{"/src/a.cxx", "-MQ", "a.o", "-I", "/src/inc"},
+     "/src/a.cxx",
+     {"-I", "/src/inc"}, 0},
+    {{"-I", "/src/inc", "-Wall", "/src/a.cxx"},
+     "/src/a.cxx",
+     {"-I", "/src/inc", "-Wall"}, 3},
+
+    // Values of options are never taken for the source file
+    {{"-include", "/src/a.cxx", "-x", "c++", "/src/a.cxx"},
+     "/src/a.cxx",
+     {"-include", "/src/a.cxx", "-x", "c++"}, 4},
+
+    // Other files are kept as flags; only the first occurrence of the
+    // source file is removed
+    {{"/src/b.cxx", "/src/a.cxx", "/src/a.cxx"},
+     "/src/a.cxx",
+     {"/src/b.cxx", "/src/a.cxx"}, 1},
+
+    // Unknown source file
+    {{"-c", "/src/b.cxx"},
+     "/src/a.cxx",
+     {"-c", "/src/b.cxx"}, -1},
+  };
+
+  for (const auto & c : cases) {
+    const CompileCommand::Flags flags = CompileCommand::flags (c.args, c.source);
+    check (flags.args == c.expected);
+    check (flags.position == c.position);
+
+    // The command is rebuilt with the source file at its original position
+    Args command = flags.command ("/src/c.cxx");
+    Args expected = c.expected;
+    if (c.position >= 0) {
+      expected.insert (expected.begin() + c.position, "/src/c.cxx");
+    }
+    check (command == expected);
+  }
+
+  // Files sharing the same flags get the same commands, but for the source
+  const CompileCommand::Flags a = CompileCommand::flags ({"-c", "/src/a.cxx", "-o", "/src/a.o"}, "/src/a.cxx");
+  const CompileCommand::Flags b = CompileCommand::flags ({"-c", "/src/b.cxx", "-o", "/src/b.o"}, "/src/b.cxx");
+  check (a.args == b.args);
+  check (a.command ("/src/a.cxx") == Args ({"-c", "/src/a.cxx"}));
+}
+
+
+int main () {
+  try {
+    testSplit();
+    testReader();
+    testReaderErrors();
+    testNormalize();
+    testFlags();
+  }
+  catch (...) {
+    std::cerr << "Caught exception!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
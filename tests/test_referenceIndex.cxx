@@ -0,0 +1,117 @@
+#include "referenceIndex.hxx"
+#include <iostream>
+
+void check (bool expr) {
+  if (!expr) {
+    throw std::string ("Error");
+  }
+}
+
+Storage::FileReference ref (int offset1, int offset2, int usrId) {
+  Storage::FileReference ret;
+  ret.offset1 = offset1;
+  ret.offset2 = offset2;
+  ret.line1 = ret.line2 = ret.col1 = ret.col2 = 0;
+  ret.usrId = usrId;
+  ret.kindId = ret.spellingId = 0;
+  return ret;
+}
+
+// USRs of the references containing `offset`, in the order returned by find()
+std::vector<int> find (const ReferenceIndex::File & file, int offset) {
+  std::vector<const Storage::FileReference *> refs;
+  file.find (offset, refs);
+
+  std::vector<int> ret;
+  for (const auto r : refs) {
+    ret.push_back (r->usrId);
+  }
+  return ret;
+}
+
+
+void testFind () {
+  std::cout << "Testing File::find..." << std::endl;
+
+  // A namespace spanning the whole file, with nested declarations and
+  // references (sorted by start offset, as in the database)
+  ReferenceIndex::File file ({
+      ref (0,    1000, 1),   // namespace
+      ref (10,   500,  2),   //   class
+      ref (20,   100,  3),   //     method
+      ref (30,   35,   4),   //       reference
+      ref (30,   35,   5),   //       reference, same extent
+      ref (40,   60,   6),   //       reference
+      ref (200,  300,  7),   //     method
+      ref (600,  605,  8),   //   function
+    });
+
+  check (find (file, 32)   == std::vector<int> ({5, 4, 3, 2, 1}));
+  check (find (file, 50)   == std::vector<int> ({6, 3, 2, 1}));
+  check (find (file, 100)  == std::vector<int> ({3, 2, 1}));
+  check (find (file, 150)  == std::vector<int> ({2, 1}));
+  check (find (file, 250)  == std::vector<int> ({7, 2, 1}));
+  check (find (file, 600)  == std::vector<int> ({8, 1}));
+  check (find (file, 0)    == std::vector<int> ({1}));
+  check (find (file, 1000) == std::vector<int> ({1}));
+  check (find (file, 1001) == std::vector<int> ());
+  check (find (file, -1)   == std::vector<int> ());
+
+  // Empty file
+  ReferenceIndex::File empty ({});
+  check (find (empty, 0) == std::vector<int> ());
+}
+
+
+void testFindExhaustive () {
+  std::cout << "Testing File::find against a linear scan..." << std::endl;
+
+  // Nested and overlapping references of various sizes
+  std::vector<Storage::FileReference> refs;
+  refs.push_back (ref (0, 2000, 0));
+  unsigned int seed = 42;
+  for (int i = 1 ; i < 500 ; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const int offset1 = (seed >> 8) % 2000;
+    seed = seed * 1103515245 + 12345;
+    const int length  = (seed >> 8) % ((i % 10 == 0) ? 1000 : 20);
+    refs.push_back (ref (offset1, offset1 + length, i));
+  }
+  std::stable_sort (refs.begin(), refs.end(),
+                    [](const Storage::FileReference & a, const Storage::FileReference & b) {
+                      return a.offset1 < b.offset1;
+                    });
+
+  ReferenceIndex::File file ((std::vector<Storage::FileReference> (refs)));
+  for (int offset = -1 ; offset <= 3001 ; ++offset) {
+    std::vector<size_t> expected;
+    for (size_t i = refs.size() ; i > 0 ; --i) {
+      if (refs[i-1].offset1 <= offset && offset <= refs[i-1].offset2) {
+        expected.push_back (i-1);
+      }
+    }
+    std::stable_sort (expected.begin(), expected.end(), [&refs](size_t a, size_t b) {
+        return (refs[a].offset2 - refs[a].offset1) < (refs[b].offset2 - refs[b].offset1);
+      });
+
+    std::vector<int> usrs;
+    for (size_t i : expected) {
+      usrs.push_back (refs[i].usrId);
+    }
+    check (find (file, offset) == usrs);
+  }
+}
+
+
+int main () {
+  try {
+    testFind();
+    testFindExhaustive();
+  }
+  catch (...) {
+    std::cerr << "Caught exception!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
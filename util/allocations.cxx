@@ -0,0 +1,38 @@
+#include "allocations.hxx"
+#include <cstdlib>
+#include <new>
+
+// Replacement for the global allocation function, counting allocations in
+// each thread. All other forms of operator new (arrays, nothrow) end up
+// calling this one.
+namespace {
+  thread_local unsigned long allocations = 0;
+}
+
+unsigned long AllocationCounter::total_ () {
+  return allocations;
+}
+
+void * operator new (std::size_t size) {
+  ++allocations;
+  if (size == 0) {
+    size = 1;
+  }
+
+  while (true) {
+    void * ptr = std::malloc (size);
+    if (ptr) {
+      return ptr;
+    }
+
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void operator delete (void * ptr) noexcept {
+  std::free (ptr);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+/** @addtogroup util
+ *  @{
+ */
+
+/** @brief Counter of dynamic memory allocations
+ *
+ * Allocations made through the global operator new are counted separately in
+ * each thread (see allocations.cxx, which must be linked in). This allows
+ * checking that a piece of code does not allocate memory.
+ *
+ * Example use:
+ * @snippet test_util.cxx AllocationCounter
+ */
+class AllocationCounter {
+public:
+  /** @brief Constructor
+   *
+   * Create a new counter and start counting allocations in the current thread.
+   */
+  AllocationCounter () {
+    reset();
+  }
+
+  /** @brief Get the number of allocations
+   *
+   * Allocations are counted since the counter creation or last reset().
+   *
+   * @return number of allocations made by the current thread
+   */
+  unsigned long get () const {
+    return total_() - start_;
+  }
+
+  /** @brief Reset counter
+   *
+   * Start counting allocations from the current instant on.
+   */
+  void reset () {
+    start_ = total_();
+  }
+
+private:
+  static unsigned long total_ ();
+  unsigned long start_;
+};
+
+/** @} */
@@ -3,7 +3,9 @@
  * This example shows how to use the classes of the @ref util module
  */
 #include "util/util.hxx"
+#include "util/allocations.hxx"
 #include <sstream>
+#include <thread>
 
 void check (bool expr) {
   if (!expr) {
@@ -53,11 +55,123 @@ void testTee () {
 }
 
 
+void testQueue () {
+  std::cout << "Testing Queue..." << std::endl;
+
+  //![Queue]
+  Queue<int> queue;
+
+  // Produce items in a separate thread
+  std::thread producer ([&queue] {
+      for (int i = 1 ; i <= 10 ; ++i) {
+        queue.push (i);
+      }
+      queue.push (0);
+    });
+
+  // Consume them in the main thread, in the same order
+  int sum = 0;
+  int item;
+  while ((item = queue.pop()) != 0) {
+    sum += item;
+  }
+  producer.join();
+  //![Queue]
+
+  check (sum == 55);
+}
+
+
+void testPrefixSet () {
+  std::cout << "Testing PrefixSet..." << std::endl;
+
+  //![PrefixSet]
+  PrefixSet exclude ({"/usr", "/opt/local", "/usr/include"});
+
+  check (exclude.matches ("/usr/include/stdio.h"));
+  check (exclude.matches ("/home/user/main.cxx") == false);
+  //![PrefixSet]
+
+
+  // Additional tests
+  check (exclude.matches ("/opt/local/include/foo.h"));
+  check (exclude.matches ("/opt/foo.h") == false);
+  check (exclude.matches ("/us") == false);
+  check (exclude.matches ("") == false);
+  check (PrefixSet ({}).matches ("/usr") == false);
+  check (PrefixSet ({""}).matches ("/home"));
+}
+
+
+void testStringPool () {
+  std::cout << "Testing StringPool..." << std::endl;
+
+  //![StringPool]
+  StringPool pool;
+  const unsigned int foo = pool.id ("foo");
+  const unsigned int bar = pool.id ("bar");
+
+  check (pool.id ("foo") == foo);
+  check (std::string (pool.get (bar)) == "bar");
+  //![StringPool]
+
+
+  // Additional tests
+  check (foo == 0 && bar == 1);
+  check (pool.id ("fo") != foo);
+  check (pool.id ("") == 3);
+
+  // Growing the pool keeps all ids
+  for (int i = 0 ; i < 1000 ; ++i) {
+    pool.id (std::to_string (i).c_str());
+  }
+  check (pool.size() == 1004);
+  check (pool.id ("foo") == foo);
+  check (std::string (pool.get (pool.id ("999"))) == "999");
+}
+
+
+void testAllocationCounter () {
+  std::cout << "Testing AllocationCounter..." << std::endl;
+
+  StringPool pool;
+  const std::string name (100, 'x');
+  pool.id (name.c_str());
+
+  //![AllocationCounter]
+  AllocationCounter allocations;
+
+  // Looking up a string already in the pool does not allocate
+  pool.id (name.c_str());
+  check (allocations.get() == 0);
+
+  // Copying a long string does
+  std::string copy (name);
+  check (allocations.get() == 1);
+  //![AllocationCounter]
+
+
+  // Additional tests
+  allocations.reset();
+  check (allocations.get() == 0);
+
+  // Allocations are counted per thread
+  std::thread other ([] { std::vector<int> v (10); });
+  allocations.reset();
+  other.join();
+  check (allocations.get() == 0);
+}
+
+
 int main () {
   try {
     testTimer();
     testString();
     testTee();
+    testQueue();
+    testPrefixSet();
+    testStringPool();
+    testAllocationCounter();
   }
   catch (...) {
     std::cerr << "Caught exception!" << std::endl;
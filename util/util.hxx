@@ -1,7 +1,14 @@
 #pragma once
 
 #include <sys/time.h>
+#include <cstring>
 #include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 /** @defgroup util Utilities
  *  @brief Various utilities
@@ -132,4 +139,215 @@ private:
   std::ostream & stream2_;
 };
 
+
+/** @brief Thread-safe FIFO queue
+ *
+ * Items pushed by producer threads are handed out in order to consumer
+ * threads. Consumers block in pop() until an item is available.
+ *
+ * Example use:
+ * @snippet test_util.cxx Queue
+ */
+template <typename T>
+class Queue {
+public:
+  /** @brief Add an item at the end of the queue
+   *
+   * Wake up one consumer thread waiting in pop(), if any.
+   *
+   * @param item  item to be added
+   */
+  void push (const T & item) {
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      items_.push_back (item);
+    }
+    available_.notify_one();
+  }
+
+  /** @brief Remove the first item of the queue
+   *
+   * Block until an item is available.
+   *
+   * @return the first item in the queue
+   */
+  T pop () {
+    std::unique_lock<std::mutex> lock (mutex_);
+    available_.wait (lock, [this] { return !items_.empty(); });
+
+    T item = items_.front();
+    items_.pop_front();
+    return item;
+  }
+
+private:
+  std::mutex              mutex_;
+  std::condition_variable available_;
+  std::deque<T>           items_;
+};
+
+
+/** @brief Set of string prefixes
+ *
+ * Tell whether strings begin with any prefix of a set. The set is compiled
+ * once: prefixes extending another prefix of the set are dropped, and the
+ * remaining ones are sorted, so that only one candidate prefix needs to be
+ * compared with each string.
+ *
+ * Example use:
+ * @snippet test_util.cxx PrefixSet
+ */
+class PrefixSet {
+public:
+  /** @brief Constructor
+   *
+   * @param prefixes  prefixes of the set
+   */
+  PrefixSet (std::vector<std::string> prefixes) {
+    std::sort (prefixes.begin(), prefixes.end());
+
+    // An extension of a prefix comes after it in sorted order, and so do all
+    // strings in between
+    for (const auto & prefix : prefixes) {
+      if (prefixes_.empty()
+          || prefix.compare (0, prefixes_.back().size(), prefixes_.back()) != 0) {
+        prefixes_.push_back (prefix);
+      }
+    }
+  }
+
+  /** @brief Tell whether a string begins with a prefix of the set
+   *
+   * @param str  string to be tested
+   *
+   * @return @c true iff @c str begins with one of the prefixes
+   */
+  bool matches (const char * str) const {
+    // The only candidate is the last prefix not greater than the string
+    auto it = std::upper_bound (prefixes_.begin(), prefixes_.end(), str,
+                                [](const char * str, const std::string & prefix) {
+                                  return prefix.compare (str) > 0;
+                                });
+    if (it == prefixes_.begin()) {
+      return false;
+    }
+    --it;
+    return std::strncmp (it->c_str(), str, it->size()) == 0;
+  }
+
+private:
+  std::vector<std::string> prefixes_;
+};
+
+
+/** @brief Pool of interned strings
+ *
+ * Each distinct string added to the pool is stored once, and identified by an
+ * integer id, counted from 0 in order of first appearance. All characters are
+ * stored in a single buffer, and strings are looked up through an
+ * open-addressing hash table: once the pool has reached its working size,
+ * interning a string does not allocate memory.
+ *
+ * Example use:
+ * @snippet test_util.cxx StringPool
+ */
+class StringPool {
+public:
+  StringPool ()
+    : buckets_ (64, EMPTY)
+  { }
+
+  /** @brief Get the id of a string, adding it to the pool if needed
+   *
+   * @param str  C string to be interned
+   *
+   * @return the string id
+   */
+  unsigned int id (const char * str) {
+    const size_t size = std::strlen (str);
+    const size_t hash = hash_ (str, size);
+
+    size_t bucket = find_ (hash, str, size);
+    if (buckets_[bucket] != EMPTY) {
+      return buckets_[bucket];
+    }
+
+    const unsigned int id = offsets_.size();
+    offsets_.push_back (chars_.size());
+    hashes_.push_back (hash);
+    chars_.insert (chars_.end(), str, str + size + 1);
+
+    buckets_[bucket] = id;
+    if (2 * offsets_.size() > buckets_.size()) {
+      rehash_ ();
+    }
+    return id;
+  }
+
+  /** @brief Get a string from its id
+   *
+   * The returned pointer is invalidated when strings are added to the pool.
+   *
+   * @param id  string id, as returned by id()
+   *
+   * @return the C string
+   */
+  const char * get (unsigned int id) const {
+    return &(chars_[offsets_[id]]);
+  }
+
+  /** @brief Get the number of strings in the pool
+   *
+   * @return the number of distinct strings interned so far
+   */
+  unsigned int size () const {
+    return offsets_.size();
+  }
+
+private:
+  enum : unsigned int { EMPTY = ~0u };
+
+  static size_t hash_ (const char * str, size_t size) {
+    // FNV-1a
+    size_t hash = 14695981039346656037ull;
+    for (size_t i = 0 ; i < size ; ++i) {
+      hash = (hash ^ (unsigned char)str[i]) * 1099511628211ull;
+    }
+    return hash;
+  }
+
+  // Bucket holding the string, or empty bucket where it should be added
+  size_t find_ (size_t hash, const char * str, size_t size) const {
+    const size_t mask = buckets_.size() - 1;
+    for (size_t bucket = hash & mask ; ; bucket = (bucket + 1) & mask) {
+      const unsigned int id = buckets_[bucket];
+      if (id == EMPTY) {
+        return bucket;
+      }
+      if (hashes_[id] == hash
+          && std::strncmp (get (id), str, size) == 0
+          && get (id)[size] == '\0') {
+        return bucket;
+      }
+    }
+  }
+
+  void rehash_ () {
+    buckets_.assign (2 * buckets_.size(), EMPTY);
+    const size_t mask = buckets_.size() - 1;
+    for (unsigned int id = 0 ; id < offsets_.size() ; ++id) {
+      size_t bucket = hashes_[id] & mask;
+      while (buckets_[bucket] != EMPTY) {
+        bucket = (bucket + 1) & mask;
+      }
+      buckets_[bucket] = id;
+    }
+  }
+
+  std::vector<char>         chars_;
+  std::vector<size_t>       offsets_;
+  std::vector<size_t>       hashes_;
+  std::vector<unsigned int> buckets_;
+};
+
 /** @} */
@@ -0,0 +1,112 @@
+#include "application.hxx"
+#include "json/json.h"
+
+#include <sstream>
+
+void Application::watch (unsigned int delay) {
+  std::lock_guard<std::mutex> lock (writeMutex_);
+
+  watcher_.reset (new Watcher (delay, [this](const std::set<std::string> & modified) {
+        return backgroundUpdate_ (modified);
+      }));
+  watchFiles_ ();
+}
+
+void Application::status (std::ostream & cout) {
+  // Don't wait for running requests or updates
+  Json::FastWriter writer;
+  Json::Value json;
+
+  json["watching"] = (bool)watcher_;
+  if (watcher_) {
+    const Watcher::Status status = watcher_->status();
+    json["files"]      = status.files;
+    json["pending"]    = status.pending;
+    json["updating"]   = status.updating;
+    json["lastChange"] = status.lastChange;
+    json["lastUpdate"] = status.lastUpdate;
+    json["errors"]     = status.errors;
+    json["upToDate"]   = (status.pending == 0 && !status.updating && status.errors == 0);
+  }
+
+  // Parsing times, to compare parsing modes
+  const char * modes[] = {"default", "editing", "indexing"};
+  for (int mode = LibClang::Index::Default ; mode <= LibClang::Index::Indexing ; ++mode) {
+    const LibClang::Index::Statistics stats
+      = LibClang::Index::statistics ((LibClang::Index::ParseMode)mode);
+    Json::Value & jsonMode = json["parse"][modes[mode]];
+    jsonMode["parses"]      = (Json::UInt64)stats.parses;
+    jsonMode["parseTime"]   = stats.parseTime;
+    jsonMode["reparses"]    = (Json::UInt64)stats.reparses;
+    jsonMode["reparseTime"] = stats.reparseTime;
+  }
+
+  // Translation units reused for completion
+  const LibClang::TranslationUnitCache::Statistics stats = tu_.statistics();
+  json["translationUnits"]["parses"]   = (Json::UInt64)stats.misses;
+  json["translationUnits"]["reparses"] = (Json::UInt64)stats.reparses;
+  json["translationUnits"]["skipped"]  = (Json::UInt64)stats.skips;
+
+  cout << writer.write (json);
+}
+
+void Application::stats (std::ostream & cout) {
+  std::lock_guard<std::mutex> lock (parseMutex_);
+
+  Json::FastWriter writer;
+  Json::Value json;
+
+  json["resident"] = (Json::UInt64)LibClang::TranslationUnitCache::residentMemory();
+  json["cache"]    = (Json::UInt64)tu_.memoryUsage();
+
+  json["translationUnits"] = Json::arrayValue;
+  for (const auto & entry : tu_.entries()) {
+    Json::Value jsonEntry;
+    jsonEntry["file"]   = entry.fileName;
+    jsonEntry["flags"]  = entry.flags;
+    jsonEntry["memory"] = (Json::UInt64)entry.memory;
+    jsonEntry["hits"]   = entry.hits;
+    jsonEntry["cost"]   = entry.cost;
+    json["translationUnits"].append (jsonEntry);
+  }
+
+  // Translation units loaded from the on-disk cache by find
+  json["astCache"]["loads"]  = (Json::UInt64)ast_.hits();
+  json["astCache"]["parses"] = (Json::UInt64)ast_.misses();
+
+  cout << writer.write (json);
+}
+
+unsigned int Application::backgroundUpdate_ (const std::set<std::string> & modified) {
+  std::cerr << "Background update (" << modified.size() << " modified files)..."
+            << std::flush;
+  Timer timer;
+
+  IndexArgs args;
+  args.diagnostics  = false;
+  args.jobs         = 0;
+  args.deferIndexes = false;
+
+  std::ostringstream log;
+  update (args, log);
+
+  std::cerr << "\t" << timer.get() << "s." << std::endl;
+
+  // Only errors are worth reporting from the update log
+  unsigned int errors = 0;
+  std::istringstream lines (log.str());
+  std::string line;
+  while (std::getline (lines, line)) {
+    if (line.compare (0, 9, "  error: ") == 0) {
+      std::cerr << line << std::endl;
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+void Application::watchFiles_ () {
+  if (watcher_) {
+    watcher_->watch (storage_.fileNames());
+  }
+}
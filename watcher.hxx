@@ -0,0 +1,227 @@
+#pragma once
+
+#include "util/util.hxx"
+
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <unistd.h>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+// Watch source files for modifications
+//
+// A background thread monitors (using inotify) the directories containing all
+// watched files. Watching directories rather than files themselves allows
+// catching editors which save files by renaming a new version over them.
+//
+// Modifications are debounced: once no file has been modified for a given
+// delay, the callback is run in the background thread (at low priority) with
+// the set of modified files. It returns the number of errors which occurred,
+// which is reported by status().
+class Watcher {
+public:
+  typedef std::function<unsigned int (const std::set<std::string> &)> Callback;
+
+  Watcher (unsigned int delay, Callback callback)
+    : delay_ (1e-3 * delay),
+      callback_ (callback),
+      updating_ (false),
+      changed_ (false),
+      updated_ (false),
+      errors_ (0)
+  {
+    inotify_ = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_ == -1) {
+      throw std::runtime_error ("could not initialize inotify");
+    }
+    if (pipe (stop_) != 0) {
+      close (inotify_);
+      throw std::runtime_error ("could not create pipe");
+    }
+
+    thread_ = std::thread (&Watcher::run_, this);
+  }
+
+  ~Watcher () {
+    // Wake up and stop the background thread
+    char c = 0;
+    if (write (stop_[1], &c, 1) == 1) {
+      thread_.join();
+    } else {
+      thread_.detach();
+    }
+
+    close (stop_[0]);
+    close (stop_[1]);
+    close (inotify_);
+  }
+
+  // Set the list of watched files
+  void watch (const std::vector<std::string> & fileNames) {
+    std::lock_guard<std::mutex> lock (mutex_);
+
+    files_.clear();
+    std::set<std::string> directories;
+    for (const auto & fileName : fileNames) {
+      files_.insert (fileName);
+      directories.insert (fileName.substr (0, fileName.rfind ('/')));
+    }
+
+    // Stop watching directories which are not needed anymore
+    for (auto it = watches_.begin() ; it != watches_.end() ; ) {
+      if (directories.count (it->second) == 0) {
+        inotify_rm_watch (inotify_, it->first);
+        it = watches_.erase (it);
+      } else {
+        directories.erase (it->second);
+        ++it;
+      }
+    }
+
+    // Watch new directories
+    for (const auto & directory : directories) {
+      const int wd = inotify_add_watch (inotify_, directory.c_str(),
+                                        IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                                        | IN_MOVED_FROM | IN_MOVED_TO);
+      if (wd == -1) {
+        std::cerr << "Warning: could not watch directory `" << directory << "'" << std::endl;
+        continue;
+      }
+      watches_[wd] = directory;
+    }
+  }
+
+  struct Status {
+    unsigned int files;         // number of watched files
+    unsigned int pending;       // number of modified files waiting to be handled
+    bool         updating;      // whether the callback is currently running
+    double       lastChange;    // time elapsed since the last modification (or -1)
+    double       lastUpdate;    // time elapsed since the last callback run (or -1)
+    unsigned int errors;        // number of errors during the last callback run
+  };
+
+  Status status () {
+    std::lock_guard<std::mutex> lock (mutex_);
+    Status res;
+    res.files      = files_.size();
+    res.pending    = pending_.size();
+    res.updating   = updating_;
+    res.lastChange = changed_ ? lastChange_.get() : -1;
+    res.lastUpdate = updated_ ? lastUpdate_.get() : -1;
+    res.errors     = errors_;
+    return res;
+  }
+
+private:
+  void run_ () {
+    // Lower the priority of this thread (and threads it creates)
+    setpriority (PRIO_PROCESS, syscall (SYS_gettid), 10);
+
+    while (true) {
+      int timeout = -1;
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        if (!pending_.empty()) {
+          timeout = std::max (0., 1e3 * (delay_ - lastChange_.get()));
+        }
+      }
+
+      struct pollfd fds[2];
+      fds[0].fd = stop_[0];  fds[0].events = POLLIN;
+      fds[1].fd = inotify_;  fds[1].events = POLLIN;
+      if (poll (fds, 2, timeout) > 0) {
+        if (fds[0].revents) {
+          break;
+        }
+        if (fds[1].revents & POLLIN) {
+          readEvents_ ();
+        }
+      }
+
+      std::set<std::string> modified;
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        if (!pending_.empty() && lastChange_.get() >= delay_) {
+          modified.swap (pending_);
+          updating_ = true;
+        }
+      }
+
+      if (!modified.empty()) {
+        unsigned int errors;
+        try {
+          errors = callback_ (modified);
+        } catch (std::exception & e) {
+          std::cerr << "Background update failed: " << e.what() << std::endl;
+          errors = 1;
+        }
+
+        std::lock_guard<std::mutex> lock (mutex_);
+        errors_ = errors;
+        updating_ = false;
+        updated_ = true;
+        lastUpdate_.reset();
+      }
+    }
+  }
+
+  void readEvents_ () {
+    char buffer[4096]
+      __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+
+    std::lock_guard<std::mutex> lock (mutex_);
+    ssize_t len;
+    while ((len = read (inotify_, buffer, sizeof (buffer))) > 0) {
+      const struct inotify_event * event;
+      for (char * ptr = buffer ; ptr < buffer + len ;
+           ptr += sizeof (struct inotify_event) + event->len) {
+        event = (const struct inotify_event *) ptr;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          // Events were lost: consider all files as modified
+          pending_.insert (files_.begin(), files_.end());
+          lastChange_.reset();
+          changed_ = true;
+          continue;
+        }
+
+        auto directory = watches_.find (event->wd);
+        if (event->len == 0 || directory == watches_.end()) {
+          continue;
+        }
+
+        const std::string fileName = directory->second + "/" + event->name;
+        if (files_.count (fileName) > 0) {
+          pending_.insert (fileName);
+          lastChange_.reset();
+          changed_ = true;
+        }
+      }
+    }
+  }
+
+  const double               delay_;
+  Callback                   callback_;
+  int                        inotify_;
+  int                        stop_[2];
+  std::thread                thread_;
+
+  // Everything below is protected by mutex_
+  std::mutex                 mutex_;
+  std::map<int, std::string> watches_;
+  std::set<std::string>      files_;
+  std::set<std::string>      pending_;
+  bool                       updating_;
+  bool                       changed_;
+  Timer                      lastChange_;
+  bool                       updated_;
+  Timer                      lastUpdate_;
+  unsigned int               errors_;
+};